@@ -0,0 +1,165 @@
+/**
+ * \file bench/mix.cc
+ *
+ * \brief
+ * Measure the cost of the audio callback's mixing at full polyphony.
+ *
+ * The work of the audio callback is reproduced on synthetic samples: copy a
+ * buffer of music, mix the 16 effect tracks and the looping track on top of
+ * it, and clip the result. It is timed with every mixing kernel the processor
+ * supports, first with every track playing, then with every track idle.
+ *
+ * The cost is reported per callback, and as a fraction of the time a buffer
+ * lasts, which is the budget the callback must fit in.
+ */
+
+#include "audio/mix.h"
+#include "audio/sample.h"
+#include "audio/track.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Work in stereo. */
+static const int channels = 2;
+
+/** Like the audio module's SDL buffer. */
+static const int buffer_size = 2048;
+
+static const int sample_rate = 44100;
+
+/** 16 effect tracks and the looping track. */
+static const int track_count = 17;
+
+static const char *kernel_names[] = {"scalar", "sse2", "avx2"};
+
+template<typename F>
+static double seconds(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+/**
+ * Fill a sample with one second of noise, long enough to span many buffers.
+ */
+static void make_sample(std::mt19937 &rng, oshu::sample *sample)
+{
+	std::uniform_real_distribution<float> noise(-1, 1);
+	sample->nb_samples = sample_rate;
+	sample->size = sample->nb_samples * channels * sizeof(float);
+	sample->samples = (float*) malloc(sample->size);
+	for (int i = 0; i < sample->nb_samples * channels; ++i)
+		sample->samples[i] = noise(rng);
+}
+
+/**
+ * Do what the audio callback does, without SDL and ffmpeg.
+ */
+static void callback(const float *music, oshu::track *tracks, float *buffer)
+{
+	memcpy(buffer, music, buffer_size * channels * sizeof(float));
+	for (int i = 0; i < track_count; ++i)
+		oshu::mix_track(&tracks[i], buffer, buffer_size);
+	oshu::clip_samples(buffer, buffer_size * channels);
+}
+
+static void measure(const char *name, const float *music, oshu::track *tracks, bool active, oshu::sample *samples, int callbacks)
+{
+	std::vector<float> buffer(buffer_size * channels);
+	for (int i = 0; i < track_count; ++i)
+		oshu::start_track(&tracks[i], active ? &samples[i] : NULL, .5, 1);
+	callback(music, tracks, buffer.data()); /* warm up */
+	double time = seconds([&] {
+		for (int i = 0; i < callbacks; ++i)
+			callback(music, tracks, buffer.data());
+	});
+	double per_callback = time / callbacks;
+	double budget = (double) buffer_size / sample_rate;
+	printf("%-8s %-8s %10.2f %10.4f\n", name, active ? "playing" : "idle", per_callback * 1e6, per_callback / budget * 100);
+}
+
+/* Command line **************************************************************/
+
+enum option_values {
+	OPT_CALLBACKS = 'n',
+	OPT_HELP = 'h',
+};
+
+static struct option options[] = {
+	{"callbacks", required_argument, 0, OPT_CALLBACKS},
+	{"help", no_argument, 0, OPT_HELP},
+	{0, 0, 0, 0},
+};
+
+static const char *flags = "n:h";
+
+static const char *usage =
+	"Usage: bench_mix [OPTION]...\n"
+;
+
+static const char *help =
+	"Options:\n"
+	"  -n, --callbacks=N       Number of callbacks to time per kernel (20000).\n"
+	"  -h, --help              Show this help message.\n"
+;
+
+int main(int argc, char **argv)
+{
+	int callbacks = 20000;
+
+	for (;;) {
+		int c = getopt_long(argc, argv, flags, options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case OPT_CALLBACKS:
+			callbacks = atoi(optarg);
+			break;
+		case OPT_HELP:
+			puts(usage);
+			fputs(help, stdout);
+			return 0;
+		default:
+			fputs(usage, stderr);
+			return 2;
+		}
+	}
+	if (optind != argc || callbacks < 1) {
+		fputs(usage, stderr);
+		return 2;
+	}
+
+	std::mt19937 rng(42);
+	oshu::sample samples[track_count];
+	for (oshu::sample &sample : samples)
+		make_sample(rng, &sample);
+	std::vector<float> music(buffer_size * channels);
+	std::uniform_real_distribution<float> noise(-1, 1);
+	for (float &s : music)
+		s = noise(rng);
+	oshu::track tracks[track_count];
+
+	oshu::mix_kernel best = oshu::get_mix_kernel();
+	printf("%d callbacks of %d samples, %d tracks\n", callbacks, buffer_size, track_count);
+	printf("%-8s %-8s %10s %10s\n", "kernel", "tracks", "us/call", "% budget");
+	for (int k = oshu::SCALAR_KERNEL; k <= oshu::AVX2_KERNEL; ++k) {
+		if (oshu::set_mix_kernel((oshu::mix_kernel) k) < 0)
+			continue;
+		measure(kernel_names[k], music.data(), tracks, true, samples, callbacks);
+		measure(kernel_names[k], music.data(), tracks, false, samples, callbacks);
+	}
+	oshu::set_mix_kernel(best);
+
+	for (oshu::sample &sample : samples)
+		free(sample.samples);
+	return 0;
+}
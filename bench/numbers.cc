@@ -0,0 +1,138 @@
+/**
+ * \file bench/numbers.cc
+ *
+ * \brief
+ * Compare the number parsers of the core module with the standard library.
+ *
+ * A large synthetic [HitObjects] section is generated in memory, then every
+ * number it contains is parsed with *strtol* and *strtod* on one hand, and
+ * #oshu::read_integer and #oshu::read_decimal on the other hand. The results
+ * must be identical. Finally, the whole section is fed to the beatmap parser
+ * to give an idea of its overall throughput.
+ */
+
+#include "beatmap/beatmap.h"
+#include "core/number.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int hit_count = 200000;
+static const int rounds = 10;
+
+static std::string generate_beatmap()
+{
+	std::mt19937 rng(42);
+	std::string osu =
+		"osu file format v14\n"
+		"[General]\nAudioFilename: audio.mp3\n"
+		"[Metadata]\nTitle:Benchmark\nArtist:oshu!\nVersion:Numbers\n"
+		"[Difficulty]\nSliderMultiplier:1.4\nSliderTickRate:1\n"
+		"[TimingPoints]\n0,352.941176470588,4,2,1,60,1,0\n"
+		"[HitObjects]\n";
+	char line[256];
+	int time = 1000;
+	for (int i = 0; i < hit_count; ++i) {
+		int x = rng() % 512;
+		int y = rng() % 384;
+		time += 100 + rng() % 400;
+		if (i % 3) {
+			snprintf(line, sizeof(line), "%d,%d,%d,1,0,0:0:0:0:\n", x, y, time);
+		} else {
+			double length = 50 + (rng() % 10000) / 100.;
+			snprintf(line, sizeof(line), "%d,%d,%d,2,0,B|%d:%d|%d:%d,1,%.2f,2|0,0:0|0:0,0:0:0:0:\n",
+			         x, y, time, (x + 40) % 512, y, (x + 80) % 512, (y + 30) % 384, length);
+		}
+		osu += line;
+	}
+	return osu;
+}
+
+/**
+ * Find where every number of the [HitObjects] section begins.
+ */
+static std::vector<const char*> find_numbers(const std::string &osu)
+{
+	std::vector<const char*> numbers;
+	const char *c = osu.c_str() + osu.find("[HitObjects]\n") + 13;
+	bool in_number = false;
+	for (; *c; ++c) {
+		bool numeric = (*c >= '0' && *c <= '9') || *c == '.' || *c == '-';
+		if (numeric && !in_number)
+			numbers.push_back(c);
+		in_number = numeric;
+	}
+	return numbers;
+}
+
+template <typename F>
+static double measure(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; ++i)
+		f();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end - start).count() / rounds;
+}
+
+static void report(const char *name, double seconds, size_t count, double reference)
+{
+	printf("%-24s %8.2f ns/number", name, seconds / count * 1e9);
+	if (reference > 0)
+		printf("  %5.2fx", reference / seconds);
+	printf("\n");
+}
+
+int main()
+{
+	std::string osu = generate_beatmap();
+	std::vector<const char*> numbers = find_numbers(osu);
+	printf("%zu bytes, %d hit objects, %zu numbers\n", osu.size(), hit_count, numbers.size());
+
+	long long int_sum[2] = {0, 0};
+	double double_sum[2] = {0, 0};
+	char *end;
+	double strtol_time = measure([&] {
+		int_sum[0] = 0;
+		for (const char *n : numbers)
+			int_sum[0] += strtol(n, &end, 10);
+	});
+	double read_integer_time = measure([&] {
+		int_sum[1] = 0;
+		for (const char *n : numbers)
+			int_sum[1] += oshu::read_integer(n, &end);
+	});
+	double strtod_time = measure([&] {
+		double_sum[0] = 0;
+		for (const char *n : numbers)
+			double_sum[0] += strtod(n, &end);
+	});
+	double read_decimal_time = measure([&] {
+		double_sum[1] = 0;
+		for (const char *n : numbers)
+			double_sum[1] += oshu::read_decimal(n, &end);
+	});
+	report("strtol", strtol_time, numbers.size(), 0);
+	report("oshu::read_integer", read_integer_time, numbers.size(), strtol_time);
+	report("strtod", strtod_time, numbers.size(), 0);
+	report("oshu::read_decimal", read_decimal_time, numbers.size(), strtod_time);
+	if (int_sum[0] != int_sum[1] || double_sum[0] != double_sum[1]) {
+		std::cerr << "the parsers disagree" << std::endl;
+		return 1;
+	}
+
+	double parse_time = measure([&] {
+		oshu::beatmap beatmap;
+		if (oshu::parse_beatmap(osu.data(), osu.size(), &beatmap) < 0)
+			exit(1);
+		oshu::destroy_beatmap(&beatmap);
+	});
+	printf("%-24s %8.2f ms, %.1f MB/s\n", "oshu::parse_beatmap", parse_time * 1e3, osu.size() / parse_time / 1e6);
+	return 0;
+}
@@ -0,0 +1,484 @@
+/**
+ * \file bench/parser.cc
+ *
+ * \brief
+ * Measure the beatmap loader on synthetic beatmaps.
+ *
+ * A beatmap is generated from a few parameters: the number of hit objects, the
+ * ratio of sliders, the number of control points per slider, and the density
+ * of timing points. It is written to a temporary file, then loaded many times
+ * with #oshu::load_beatmap, with and without its cache, and with
+ * #oshu::load_beatmap_headers. Saving the cache with #oshu::cache_beatmap is
+ * measured on its own.
+ *
+ * The cache is written to a temporary directory, which is made the
+ * `XDG_CACHE_HOME` of the benchmark, and removed before every round that must
+ * not find it.
+ *
+ * For each of these, the throughput is reported along with the number of heap
+ * allocations per load and the peak resident memory. Every mode runs in its
+ * own process so that the peak memory of one doesn't hide the others'.
+ *
+ * With `--corpus`, a set of varied beatmaps is written to a directory instead,
+ * to seed a fuzzer or to test the parser by hand.
+ */
+
+#include "beatmap/beatmap.h"
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include <ftw.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Allocation counting *******************************************************/
+
+/*
+ * The standard allocator is wrapped to count the calls made while
+ * #counting is set. This relies on glibc exporting its implementation under
+ * these names.
+ */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<bool> counting {false};
+static std::atomic<long> allocations {0};
+static std::atomic<long> allocated_bytes {0};
+
+static void count(size_t size)
+{
+	if (counting.load(std::memory_order_relaxed)) {
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+extern "C" void *malloc(size_t size)
+{
+	count(size);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count_, size_t size)
+{
+	count(count_ * size);
+	return __libc_calloc(count_, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	count(size);
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+/* Generation ****************************************************************/
+
+struct parameters {
+	int hit_count = 20000;
+	/** Between 0 and 1. The rest are circles, plus a few spinners. */
+	double slider_ratio = .3;
+	/** For Bézier sliders, including the slider's position. */
+	int control_points = 4;
+	/** Number of timing points per 100 hit objects. */
+	int timing_density = 10;
+	unsigned int seed = 42;
+};
+
+static void append_slider(std::string &osu, std::mt19937 &rng, const parameters &params, int x, int y, int time)
+{
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%d,%d,%d,2,0,", x, y, time);
+	osu += buffer;
+	int kind = rng() % 10;
+	if (kind == 0) {
+		snprintf(buffer, sizeof(buffer), "L|%d:%d", (x + 100) % 512, y);
+		osu += buffer;
+	} else if (kind == 1) {
+		snprintf(buffer, sizeof(buffer), "P|%d:%d|%d:%d", (x + 50) % 512, (y + 50) % 384, (x + 100) % 512, y);
+		osu += buffer;
+	} else {
+		osu += 'B';
+		for (int i = 1; i < params.control_points; ++i) {
+			x = (x + 20 + rng() % 40) % 512;
+			y = (y + 20 + rng() % 40) % 384;
+			snprintf(buffer, sizeof(buffer), "|%d:%d", x, y);
+			osu += buffer;
+			/* repeat a point now and then to start a new segment */
+			if (rng() % 8 == 0 && i + 1 < params.control_points)
+				osu += buffer;
+		}
+	}
+	int repeat = 1 + rng() % 3;
+	double length = 50 + (rng() % 20000) / 100.;
+	snprintf(buffer, sizeof(buffer), ",%d,%.2f,", repeat, length);
+	osu += buffer;
+	for (int i = 0; i <= repeat; ++i) {
+		osu += i ? "|" : "";
+		osu += '0' + 2 * (rng() % 2);
+	}
+	osu += ',';
+	for (int i = 0; i <= repeat; ++i)
+		osu += i ? "|0:0" : "0:0";
+	osu += ",0:0:0:0:\n";
+}
+
+static std::string generate_beatmap(const parameters &params)
+{
+	std::mt19937 rng(params.seed);
+	std::string osu =
+		"osu file format v14\n"
+		"\n"
+		"[General]\nAudioFilename: audio.mp3\nAudioLeadIn: 0\nPreviewTime: 1000\nMode: 0\nSampleSet: Soft\n"
+		"\n"
+		"[Metadata]\nTitle:Benchmark\nTitleUnicode:Benchmark\nArtist:oshu!\nArtistUnicode:oshu!\n"
+		"Creator:bench_parser\nVersion:Synthetic\nSource:\nTags:bench synthetic parser\n"
+		"\n"
+		"[Difficulty]\nHPDrainRate:5\nCircleSize:4\nOverallDifficulty:7\nApproachRate:9\n"
+		"SliderMultiplier:1.4\nSliderTickRate:1\n"
+		"\n"
+		"[Events]\n0,0,\"background.jpg\",0,0\n"
+		"\n";
+
+	/* Place the timing points over the duration of the beatmap. */
+	int duration = params.hit_count * 300;
+	int timing_count = 1 + params.hit_count * params.timing_density / 100;
+	osu += "[TimingPoints]\n";
+	char line[256];
+	for (int i = 0; i < timing_count; ++i) {
+		int offset = (long long) duration * i / timing_count;
+		if (i % 10 == 0)
+			snprintf(line, sizeof(line), "%d,%.12f,4,2,1,60,1,0\n", offset, 60000. / (120 + rng() % 120));
+		else
+			snprintf(line, sizeof(line), "%d,-%.12f,4,2,1,%d,0,%d\n", offset, 50. + (rng() % 15000) / 100., 40 + (int) (rng() % 60), (int) (rng() % 2));
+		osu += line;
+	}
+
+	osu += "\n[Colours]\nCombo1 : 255,128,0\nCombo2 : 0,128,255\nCombo3 : 128,255,0\n\n";
+
+	osu += "[HitObjects]\n";
+	std::uniform_real_distribution<double> dice(0, 1);
+	int time = 1000;
+	for (int i = 0; i < params.hit_count; ++i) {
+		int x = rng() % 512;
+		int y = rng() % 384;
+		time += 100 + rng() % 400;
+		double roll = dice(rng);
+		if (roll < params.slider_ratio) {
+			append_slider(osu, rng, params, x, y, time);
+		} else if (roll > .98) {
+			snprintf(line, sizeof(line), "256,192,%d,12,0,%d,0:0:0:0:\n", time, time + 1000);
+			osu += line;
+			time += 1000;
+		} else {
+			snprintf(line, sizeof(line), "%d,%d,%d,%d,%d,0:0:0:0:\n", x, y, time, i % 8 ? 1 : 5, (int) (rng() % 16) & ~1);
+			osu += line;
+		}
+	}
+	return osu;
+}
+
+static int write_file(const char *path, const std::string &content)
+{
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+	size_t written = fwrite(content.data(), 1, content.size(), file);
+	if (fclose(file) != 0 || written != content.size()) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Write beatmaps covering a range of parameters, from tiny to large, with
+ * and without sliders and timing points.
+ */
+static int write_corpus(const char *directory, parameters base)
+{
+	static const int hit_counts[] = {0, 1, 10, 1000};
+	static const double slider_ratios[] = {0, .5, 1};
+	static const int control_points[] = {2, 5, 32};
+	static const int timing_densities[] = {0, 100};
+	int count = 0;
+	for (int hits : hit_counts) {
+		for (double sliders : slider_ratios) {
+			for (int points : control_points) {
+				for (int timing : timing_densities) {
+					parameters params = base;
+					params.hit_count = hits;
+					params.slider_ratio = sliders;
+					params.control_points = points;
+					params.timing_density = timing;
+					params.seed = base.seed + count;
+					char path[4096];
+					snprintf(path, sizeof(path), "%s/synthetic-%03d.osu", directory, count);
+					if (write_file(path, generate_beatmap(params)) < 0)
+						return -1;
+					++count;
+				}
+			}
+		}
+	}
+	printf("wrote %d beatmaps to %s\n", count, directory);
+	return 0;
+}
+
+/* Measurement ***************************************************************/
+
+enum mode {
+	PARSE_MODE,
+	CACHE_MODE,
+	HEADERS_MODE,
+	WRITE_MODE,
+};
+
+static const char *mode_names[] = {
+	"load_beatmap",
+	"load_beatmap (cached)",
+	"load_beatmap_headers",
+	"cache_beatmap",
+};
+
+/**
+ * The `XDG_CACHE_HOME` of the benchmark.
+ */
+static std::string cache_home;
+
+static int remove_file(const char *path, const struct stat*, int, struct FTW*)
+{
+	remove(path);
+	return 0;
+}
+
+/**
+ * Remove the cache directory, and all the beatmap caches with it.
+ */
+static void remove_cache()
+{
+	nftw(cache_home.c_str(), remove_file, 8, FTW_DEPTH | FTW_PHYS);
+}
+
+/**
+ * Load the beatmap *rounds* times in the given mode, and print a report line.
+ *
+ * Meant to run in a child process, for the peak memory usage to be its own.
+ */
+static int measure(const char *path, size_t size, int hit_count, enum mode mode, int rounds)
+{
+	oshu::beatmap beatmap;
+	if (mode == CACHE_MODE) {
+		/* warm the cache up */
+		if (oshu::load_beatmap(path, &beatmap) < 0)
+			return -1;
+		oshu::cache_beatmap(path, &beatmap);
+		oshu::destroy_beatmap(&beatmap);
+	}
+	double seconds = 0;
+	allocations = 0;
+	allocated_bytes = 0;
+	for (int i = 0; i < rounds; ++i) {
+		if (mode == PARSE_MODE || mode == WRITE_MODE)
+			remove_cache();
+		if (mode == WRITE_MODE && oshu::load_beatmap(path, &beatmap) < 0)
+			return -1;
+		counting = true;
+		auto start = std::chrono::steady_clock::now();
+		int rc = 0;
+		if (mode == HEADERS_MODE)
+			rc = oshu::load_beatmap_headers(path, &beatmap);
+		else if (mode == WRITE_MODE)
+			oshu::cache_beatmap(path, &beatmap);
+		else
+			rc = oshu::load_beatmap(path, &beatmap);
+		auto end = std::chrono::steady_clock::now();
+		counting = false;
+		if (rc < 0)
+			return -1;
+		seconds += std::chrono::duration<double>(end - start).count();
+		oshu::destroy_beatmap(&beatmap);
+	}
+	seconds /= rounds;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf(
+		"%-24s %9.3f ms %8.1f MB/s %8.2f Mobj/s %8ld allocs %9.1f KiB %8ld KiB RSS\n",
+		mode_names[mode], seconds * 1e3, size / seconds / 1e6,
+		mode == HEADERS_MODE ? 0. : hit_count / seconds / 1e6,
+		allocations / rounds, allocated_bytes / rounds / 1024., usage.ru_maxrss
+	);
+	return 0;
+}
+
+
+static int measure_in_child(const char *path, size_t size, int hit_count, enum mode mode, int rounds)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	} else if (pid == 0) {
+		int rc = measure(path, size, hit_count, mode, rounds);
+		fflush(stdout);
+		_exit(rc < 0 ? 1 : 0);
+	}
+	int status;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s failed\n", mode_names[mode]);
+		return -1;
+	}
+	return 0;
+}
+
+/* Command line **************************************************************/
+
+enum option_values {
+	OPT_HITS = 'n',
+	OPT_SLIDERS = 's',
+	OPT_CONTROL_POINTS = 'c',
+	OPT_TIMING_POINTS = 't',
+	OPT_ROUNDS = 'r',
+	OPT_SEED = 0x10000,
+	OPT_CORPUS = 0x10001,
+	OPT_HELP = 'h',
+};
+
+static struct option options[] = {
+	{"hits", required_argument, 0, OPT_HITS},
+	{"sliders", required_argument, 0, OPT_SLIDERS},
+	{"control-points", required_argument, 0, OPT_CONTROL_POINTS},
+	{"timing-points", required_argument, 0, OPT_TIMING_POINTS},
+	{"rounds", required_argument, 0, OPT_ROUNDS},
+	{"seed", required_argument, 0, OPT_SEED},
+	{"corpus", required_argument, 0, OPT_CORPUS},
+	{"help", no_argument, 0, OPT_HELP},
+	{0, 0, 0, 0},
+};
+
+static const char *flags = "n:s:c:t:r:h";
+
+static const char *usage =
+	"Usage: bench_parser [OPTION]...\n"
+	"       bench_parser --corpus DIRECTORY\n"
+;
+
+static const char *help =
+	"Options:\n"
+	"  -n, --hits=N            Number of hit objects (20000).\n"
+	"  -s, --sliders=RATIO     Ratio of sliders, from 0 to 1 (0.3).\n"
+	"  -c, --control-points=N  Control points per Bézier slider (4).\n"
+	"  -t, --timing-points=N   Timing points per 100 hit objects (10).\n"
+	"  -r, --rounds=N          Number of loads to average (10).\n"
+	"  --seed=N                Seed of the generator (42).\n"
+	"  --corpus=DIRECTORY      Write a set of varied beatmaps and exit.\n"
+	"  -h, --help              Show this help message.\n"
+;
+
+int main(int argc, char **argv)
+{
+	parameters params;
+	int rounds = 10;
+	const char *corpus = NULL;
+
+	for (;;) {
+		int c = getopt_long(argc, argv, flags, options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case OPT_HITS:
+			params.hit_count = atoi(optarg);
+			break;
+		case OPT_SLIDERS:
+			params.slider_ratio = atof(optarg);
+			break;
+		case OPT_CONTROL_POINTS:
+			params.control_points = atoi(optarg);
+			break;
+		case OPT_TIMING_POINTS:
+			params.timing_density = atoi(optarg);
+			break;
+		case OPT_ROUNDS:
+			rounds = atoi(optarg);
+			break;
+		case OPT_SEED:
+			params.seed = strtoul(optarg, NULL, 10);
+			break;
+		case OPT_CORPUS:
+			corpus = optarg;
+			break;
+		case OPT_HELP:
+			puts(usage);
+			fputs(help, stdout);
+			return 0;
+		default:
+			fputs(usage, stderr);
+			return 2;
+		}
+	}
+	if (optind != argc || params.hit_count < 0 || params.control_points < 2 || params.timing_density < 0 || rounds < 1) {
+		fputs(usage, stderr);
+		return 2;
+	}
+
+	if (corpus)
+		return write_corpus(corpus, params) < 0 ? 1 : 0;
+
+	const char *tmpdir = getenv("TMPDIR");
+	std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/bench_parser.XXXXXX";
+	int fd = mkstemp(&path[0]);
+	if (fd < 0) {
+		perror(path.c_str());
+		return 1;
+	}
+	close(fd);
+
+	size_t size;
+	{
+		std::string osu = generate_beatmap(params);
+		size = osu.size();
+		if (write_file(path.c_str(), osu) < 0)
+			return 1;
+	}
+	printf(
+		"%zu bytes, %d hit objects, %.0f%% sliders, %d control points, %d timing points per 100 objects\n",
+		size, params.hit_count, params.slider_ratio * 100, params.control_points, params.timing_density
+	);
+
+	cache_home = std::string(tmpdir ? tmpdir : "/tmp") + "/bench_parser_cache.XXXXXX";
+	if (!mkdtemp(&cache_home[0])) {
+		perror(cache_home.c_str());
+		unlink(path.c_str());
+		return 1;
+	}
+	setenv("XDG_CACHE_HOME", cache_home.c_str(), 1);
+
+	int rc = 0;
+	for (enum mode mode : {PARSE_MODE, CACHE_MODE, HEADERS_MODE, WRITE_MODE}) {
+		if (measure_in_child(path.c_str(), size, params.hit_count, mode, rounds) < 0)
+			rc = 1;
+	}
+	unlink(path.c_str());
+	remove_cache();
+	return rc;
+}
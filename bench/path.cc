@@ -0,0 +1,420 @@
+/**
+ * \file bench/path.cc
+ *
+ * \brief
+ * Measure the speed and the accuracy of the slider paths.
+ *
+ * For each corpus, a beatmap made only of sliders of one kind is generated and
+ * parsed: linear sliders, perfect arcs, and Bézier sliders of various degrees
+ * and segment counts. Then, the following operations are timed:
+ *
+ * - #oshu::normalize_path, which runs when the beatmap is loaded,
+ * - #oshu::path_at, which runs every frame for the slider ball,
+ * - #oshu::path_bounding_box, which runs when a slider is painted.
+ *
+ * The accuracy is measured against a reference computed independently, on
+ * the raw control points, with a much higher resolution. The ball deviation
+ * is the largest distance between #oshu::path_at and the reference point at
+ * the same distance from the start. The length error is the largest
+ * difference between the length of the normalized path, measured on the
+ * points the ball goes through, and the length the beatmap specifies.
+ *
+ * The ball is evaluated at a fixed number of #steps, which cut the sharp
+ * turns at the joints between segments, so that even a perfect path shows a
+ * small length error. On Bézier sliders of many segments, it reaches a few
+ * pixels.
+ *
+ * Finally, #oshu::build_arc is timed on random triplets of points.
+ */
+
+#include "beatmap/beatmap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Generation ****************************************************************/
+
+struct corpus {
+	const char *name;
+	enum oshu::path_type type;
+	/** For Bézier sliders, the number of control points per segment. */
+	int degree;
+	/** For Bézier sliders. */
+	int segments;
+};
+
+static const struct corpus corpora[] = {
+	{"linear", oshu::LINEAR_PATH, 1, 1},
+	{"perfect", oshu::PERFECT_PATH, 2, 1},
+	{"bezier d2 s1", oshu::BEZIER_PATH, 2, 1},
+	{"bezier d3 s1", oshu::BEZIER_PATH, 3, 1},
+	{"bezier d3 s4", oshu::BEZIER_PATH, 3, 4},
+	{"bezier d3 s16", oshu::BEZIER_PATH, 3, 16},
+	{"bezier d6 s1", oshu::BEZIER_PATH, 6, 1},
+	{"bezier d12 s2", oshu::BEZIER_PATH, 12, 2},
+};
+
+static oshu::point random_point(std::mt19937 &rng, oshu::point near, double spread)
+{
+	std::uniform_real_distribution<double> offset(-spread, spread);
+	double x = std::min(512., std::max(0., std::real(near) + offset(rng)));
+	double y = std::min(384., std::max(0., std::imag(near) + offset(rng)));
+	return oshu::point(std::round(x), std::round(y));
+}
+
+static void append_point(std::string &osu, oshu::point p)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "|%d:%d", (int) std::real(p), (int) std::imag(p));
+	osu += buffer;
+}
+
+/**
+ * Generate a beatmap of *count* sliders of the given corpus.
+ *
+ * The control points follow a random walk whose heading turns by up to a
+ * radian at every step, which looks like the sliders of real beatmaps more
+ * than a purely random set of points. The length of the sliders is picked
+ * such that most of them are cut, and some of them extended.
+ */
+static std::string generate_beatmap(const struct corpus &corpus, int count, std::mt19937 &rng)
+{
+	std::string osu =
+		"osu file format v14\n"
+		"[General]\nAudioFilename: audio.mp3\n"
+		"[Metadata]\nTitle:Benchmark\nArtist:oshu!\nVersion:Paths\n"
+		"[Difficulty]\nSliderMultiplier:1.4\nSliderTickRate:1\n"
+		"[TimingPoints]\n0,352.941176470588,4,2,1,60,1,0\n"
+		"[HitObjects]\n";
+	std::uniform_real_distribution<double> stretch(.5, 1.2);
+	std::uniform_real_distribution<double> turn(-1, 1);
+	std::uniform_real_distribution<double> step(20, 60);
+	char buffer[64];
+	for (int i = 0; i < count; ++i) {
+		oshu::point start = random_point(rng, oshu::point(256, 192), 200);
+		snprintf(buffer, sizeof(buffer), "%d,%d,%d,2,0,%c", (int) std::real(start), (int) std::imag(start), 1000 + i * 500, corpus.type);
+		osu += buffer;
+		oshu::point p = start;
+		double heading = turn(rng) * M_PI;
+		double length = 0;
+		int points = corpus.type == oshu::BEZIER_PATH ? corpus.degree * corpus.segments : corpus.degree;
+		for (int j = 1; j <= points; ++j) {
+			oshu::point next;
+			do {
+				heading += turn(rng);
+				next = random_point(rng, p + std::polar(step(rng), heading), 0);
+			} while (next == p || next == start);
+			length += std::abs(next - p);
+			append_point(osu, next);
+			/* repeat the last point of a segment to start the next one */
+			if (corpus.type == oshu::BEZIER_PATH && j % corpus.degree == 0 && j < points)
+				append_point(osu, next);
+			p = next;
+		}
+		/* the control polygon is longer than the curve */
+		length = std::max(10., length * stretch(rng) * .8);
+		snprintf(buffer, sizeof(buffer), ",1,%.2f\n", length);
+		osu += buffer;
+	}
+	return osu;
+}
+
+/* Reference *****************************************************************/
+
+/**
+ * A path approximated with a very fine polyline, computed from the raw
+ * control points without any of the path module's code.
+ */
+struct reference {
+	std::vector<oshu::point> points;
+	/** Distance of every point from the start, along the polyline. */
+	std::vector<double> lengths;
+	/** Direction in which to extend the path when it's too short. */
+	oshu::vector direction;
+	/** Whether a path too short by less than #extension_threshold is cut. */
+	bool lenient;
+};
+
+static const int reference_resolution = 100000;
+
+/**
+ * Like #oshu::normalize_path, don't extend Bézier paths that are too short by
+ * less than this, in pixels.
+ */
+static const double extension_threshold = 5.;
+
+static oshu::point de_casteljau(std::vector<oshu::point> pp, double t)
+{
+	for (size_t l = pp.size(); l > 1; --l) {
+		for (size_t j = 0; j < l - 1; ++j)
+			pp[j] = (1. - t) * pp[j] + t * pp[j + 1];
+	}
+	return pp[0];
+}
+
+static void add_point(struct reference &ref, oshu::point p)
+{
+	double length = ref.points.empty() ? 0 : ref.lengths.back() + std::abs(p - ref.points.back());
+	ref.points.push_back(p);
+	ref.lengths.push_back(length);
+}
+
+/**
+ * Build the reference of a freshly parsed path, before it is normalized.
+ */
+static struct reference build_reference(const oshu::path &path)
+{
+	struct reference ref {};
+	if (path.type == oshu::LINEAR_PATH) {
+		add_point(ref, path.line.start);
+		add_point(ref, path.line.end);
+		ref.direction = path.line.end - path.line.start;
+	} else if (path.type == oshu::PERFECT_PATH) {
+		const oshu::arc &arc = path.arc;
+		double direction = arc.end_angle > arc.start_angle ? 1. : -1.;
+		/* the arc is cut or extended along its circle */
+		double angle = path.length / arc.radius;
+		for (int i = 0; i <= reference_resolution; ++i)
+			add_point(ref, arc.center + std::polar(arc.radius, arc.start_angle + direction * angle * i / reference_resolution));
+	} else {
+		const oshu::bezier &bezier = path.bezier;
+		int per_segment = reference_resolution / bezier.segment_count;
+		for (int s = 0; s < bezier.segment_count; ++s) {
+			std::vector<oshu::point> pp(bezier.control_points + bezier.indices[s], bezier.control_points + bezier.indices[s + 1]);
+			for (int i = s ? 1 : 0; i <= per_segment; ++i)
+				add_point(ref, de_casteljau(pp, (double) i / per_segment));
+		}
+		int n = bezier.indices[bezier.segment_count];
+		ref.direction = bezier.control_points[n - 1] - bezier.control_points[n - 2];
+		ref.lenient = true;
+	}
+	return ref;
+}
+
+
+/**
+ * Compute the length the normalized path should have.
+ */
+static double expected_length(const struct reference &ref, double length)
+{
+	double actual = ref.lengths.back();
+	if (ref.lenient && length > actual && length <= actual + extension_threshold)
+		return actual;
+	return length;
+}
+
+/**
+ * Find the point at *length* from the start of the reference.
+ */
+static oshu::point reference_at(const struct reference &ref, double length)
+{
+	if (length >= ref.lengths.back()) {
+		double extra = length - ref.lengths.back();
+		if (std::abs(ref.direction) == 0)
+			return ref.points.back();
+		return ref.points.back() + ref.direction / std::abs(ref.direction) * extra;
+	}
+	size_t i = std::upper_bound(ref.lengths.begin(), ref.lengths.end(), length) - ref.lengths.begin();
+	assert (i > 0);
+	double span = ref.lengths[i] - ref.lengths[i - 1];
+	double k = span > 0 ? (length - ref.lengths[i - 1]) / span : 0;
+	return (1. - k) * ref.points[i - 1] + k * ref.points[i];
+}
+
+/* Measurement ***************************************************************/
+
+/**
+ * Number of points #oshu::path_at is evaluated at for each slider.
+ */
+static const int steps = 1000;
+
+struct accuracy {
+	double ball_deviation = 0;
+	double length_error = 0;
+};
+
+static void measure_accuracy(oshu::path *path, const struct reference &ref, struct accuracy *accuracy)
+{
+	double target = expected_length(ref, path->length);
+	double length = 0;
+	oshu::point previous = oshu::path_at(path, 0);
+	for (int i = 0; i <= steps; ++i) {
+		oshu::point p = oshu::path_at(path, (double) i / steps);
+		oshu::point expected = reference_at(ref, target * i / steps);
+		accuracy->ball_deviation = std::max(accuracy->ball_deviation, std::abs(p - expected));
+		length += std::abs(p - previous);
+		previous = p;
+	}
+	accuracy->length_error = std::max(accuracy->length_error, std::abs(length - target));
+}
+
+template <typename F>
+static double seconds(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end - start).count();
+}
+
+static std::vector<oshu::path*> sliders(oshu::beatmap &beatmap)
+{
+	std::vector<oshu::path*> paths;
+	for (oshu::hit *hit = beatmap.hits; hit; hit = hit->next) {
+		if (hit->type & oshu::SLIDER_HIT)
+			paths.push_back(&hit->slider.path);
+	}
+	return paths;
+}
+
+static int measure_corpus(const struct corpus &corpus, int count, int rounds, std::mt19937 &rng)
+{
+	std::string osu = generate_beatmap(corpus, count, rng);
+	double normalize_time = 0, at_time = 0, box_time = 0;
+	long paths_count = 0;
+	struct accuracy accuracy;
+
+	for (int r = 0; r < rounds; ++r) {
+		oshu::beatmap beatmap;
+		if (oshu::parse_beatmap(osu.data(), osu.size(), &beatmap) < 0)
+			return -1;
+		std::vector<oshu::path*> paths = sliders(beatmap);
+		std::vector<struct reference> references;
+		if (r == 0) {
+			for (oshu::path *path : paths)
+				references.push_back(build_reference(*path));
+		}
+
+		normalize_time += seconds([&] {
+			for (oshu::path *path : paths)
+				oshu::normalize_path(path);
+		});
+		at_time += seconds([&] {
+			for (oshu::path *path : paths) {
+				for (int i = 0; i <= steps; ++i)
+					oshu::path_at(path, (double) i / steps);
+			}
+		});
+		box_time += seconds([&] {
+			for (oshu::path *path : paths) {
+				oshu::point top_left, bottom_right;
+				oshu::path_bounding_box(path, &top_left, &bottom_right);
+			}
+		});
+		paths_count += paths.size();
+
+		for (size_t i = 0; i < references.size(); ++i)
+			measure_accuracy(paths[i], references[i], &accuracy);
+		oshu::destroy_beatmap(&beatmap);
+	}
+
+	printf(
+		"%-16s %10.1f %10.2f %10.1f %12.4f %12.4f\n",
+		corpus.name,
+		normalize_time / paths_count * 1e9,
+		at_time / paths_count / (steps + 1) * 1e9,
+		box_time / paths_count * 1e9,
+		accuracy.ball_deviation, accuracy.length_error
+	);
+	return 0;
+}
+
+static void measure_build_arc(int count, std::mt19937 &rng)
+{
+	std::vector<oshu::point> points;
+	for (int i = 0; i < 3 * count; ++i)
+		points.push_back(random_point(rng, oshu::point(256, 192), 256));
+	int failures = 0;
+	double time = seconds([&] {
+		for (int i = 0; i < count; ++i) {
+			oshu::arc arc;
+			if (oshu::build_arc(points[3 * i], points[3 * i + 1], points[3 * i + 2], &arc) < 0)
+				failures++;
+		}
+	});
+	printf("%-16s %10.1f ns/op, %d degenerate out of %d\n", "build_arc", time / count * 1e9, failures, count);
+}
+
+/* Command line **************************************************************/
+
+enum option_values {
+	OPT_SLIDERS = 'n',
+	OPT_ROUNDS = 'r',
+	OPT_HELP = 'h',
+};
+
+static struct option options[] = {
+	{"sliders", required_argument, 0, OPT_SLIDERS},
+	{"rounds", required_argument, 0, OPT_ROUNDS},
+	{"help", no_argument, 0, OPT_HELP},
+	{0, 0, 0, 0},
+};
+
+static const char *flags = "n:r:h";
+
+static const char *usage =
+	"Usage: bench_path [OPTION]...\n"
+;
+
+static const char *help =
+	"Options:\n"
+	"  -n, --sliders=N         Number of sliders per corpus (2000).\n"
+	"  -r, --rounds=N          Number of rounds to average (5).\n"
+	"  -h, --help              Show this help message.\n"
+;
+
+int main(int argc, char **argv)
+{
+	int count = 2000;
+	int rounds = 5;
+
+	for (;;) {
+		int c = getopt_long(argc, argv, flags, options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case OPT_SLIDERS:
+			count = atoi(optarg);
+			break;
+		case OPT_ROUNDS:
+			rounds = atoi(optarg);
+			break;
+		case OPT_HELP:
+			puts(usage);
+			fputs(help, stdout);
+			return 0;
+		default:
+			fputs(usage, stderr);
+			return 2;
+		}
+	}
+	if (optind != argc || count < 1 || rounds < 1) {
+		fputs(usage, stderr);
+		return 2;
+	}
+
+	std::mt19937 rng(42);
+	printf("%d sliders per corpus, %d rounds\n", count, rounds);
+	printf(
+		"%-16s %10s %10s %10s %12s %12s\n",
+		"corpus", "normalize", "path_at", "box", "deviation", "length error"
+	);
+	printf("%-16s %10s %10s %10s %12s %12s\n", "", "ns/path", "ns/op", "ns/op", "px", "px");
+	int rc = 0;
+	for (const struct corpus &corpus : corpora) {
+		if (measure_corpus(corpus, count, rounds, rng) < 0) {
+			fprintf(stderr, "could not parse the %s corpus\n", corpus.name);
+			rc = 1;
+		}
+	}
+	measure_build_arc(count * 100, rng);
+	return rc;
+}
@@ -17,6 +17,8 @@
 
 #include <SDL2/SDL.h>
 
+#include <atomic>
+
 namespace oshu {
 
 /** \defgroup audio Audio
@@ -42,9 +44,10 @@ namespace oshu {
  *
  * 1. SDL requests for audio samples by calling the callback function
  *    mentionned on device initialization.
- * 2. The callback function copies data from the current frame into SDL's
- *    supplied buffer, and requests more frames until the buffer is full.
- * 3. Frames are read from libavcodec, which keeps returning frames until the
+ * 2. The callback function copies the music samples from the stream's ring
+ *    buffer into SDL's supplied buffer, and mixes the sound effects on top.
+ * 3. Meanwhile, the stream's decoding thread keeps the ring buffer full.
+ *    Frames are read from libavcodec, which keeps returning frames until the
  *    current page is completely read. Request a new page is the current one is
  *    completely consumed.
  * 4. Packets are read from libavformat, which reads data from the audio file,
@@ -67,7 +70,9 @@ namespace oshu {
  * the *best effort timestamp*. This is what we'll use.
  *
  * Once a frame is decoded, and at the time we know its PTS, its samples are
- * sent into SDL's audio samples buffer, which are relayed to the sound card.
+ * queued in the ring buffer, and later copied into SDL's audio samples buffer,
+ * which are relayed to the sound card. The stream's position is tracked as
+ * the samples leave the ring, so the time they spent queued doesn't count.
  * The elapsed time between the frame decoding and its actual playback cannot
  * easily be determined, so we'll get a consistent lag, sadly. This consistent
  * lag can be rectified with a voluntary bias on the computed position. Note
@@ -146,14 +151,42 @@ namespace oshu {
  * \{
  */
 
+/**
+ * The kinds of #oshu::audio_command.
+ */
+enum audio_command_type {
+	/** See #oshu::play_sample. */
+	PLAY_SAMPLE_COMMAND,
+	/** See #oshu::play_loop. */
+	PLAY_LOOP_COMMAND,
+	/** See #oshu::stop_loop. */
+	STOP_LOOP_COMMAND,
+};
+
+/**
+ * A request from the game thread to the audio thread.
+ *
+ * \sa oshu::audio::commands
+ */
+struct audio_command {
+	oshu::audio_command_type type;
+	/** The sample to play, for the commands that play one. */
+	oshu::sample *sample;
+	float volume;
+};
+
 /**
  * The full audio pipeline.
  *
- * This structure is mainly accessed through an audio thread, and should be
- * locked using SDL's `SDL_LockAudioDevice` and `SDL_UnlockAudioDevice`
- * procedures in order to be accessed peacefully from another thread. You don't
- * need to bother with locking when using the accessors defined in this module
- * though. Only lock when accessing multiple fields directly.
+ * This structure is mainly accessed through an audio thread. The accessors
+ * defined in this module don't lock it, but send their requests to the audio
+ * thread through the #commands queue, so that playing a sound never makes the
+ * game thread and the audio thread wait for each other.
+ *
+ * #oshu::seek_music is the exception, as it must return the new position of
+ * the stream right away. It locks the audio thread using SDL's
+ * `SDL_LockAudioDevice` and `SDL_UnlockAudioDevice` procedures, which you
+ * should use too when accessing multiple fields directly.
  *
  * \todo
  * Rename this to oshu::audio::engine.
@@ -182,6 +215,22 @@ struct audio {
 	 * \sa oshu::play_loop
 	 */
 	oshu::track looping;
+	/**
+	 * A single-producer single-consumer queue of commands for the audio
+	 * thread.
+	 *
+	 * The game thread writes commands at #command_head, and the audio
+	 * callback executes them from #command_tail before it mixes anything.
+	 * The indices grow forever and are reduced modulo the size of the
+	 * array, which must be a power of 2. Each side only writes its own
+	 * index, so neither ever waits.
+	 *
+	 * When the queue is full, which would mean hundreds of sounds between
+	 * two callbacks, the new command is dropped.
+	 */
+	oshu::audio_command commands[256];
+	std::atomic<unsigned> command_head;
+	std::atomic<unsigned> command_tail;
 	/**
 	 * A device ID returned by SDL, and required by most SDL audio
 	 * functions.
@@ -233,6 +282,10 @@ void pause_audio(oshu::audio *audio);
  * number of samples that can be played simultaneously. When that number is
  * reached because all the effects tracks are used, the playback of one of
  * the samples is stopped to play the new sample.
+ *
+ * Like #oshu::play_loop and #oshu::stop_loop, this function only queues a
+ * command, which the audio thread executes at its next callback. It must
+ * always be called from the same thread.
  */
 void play_sample(oshu::audio *audio, oshu::sample *sample, float volume);
 
@@ -254,7 +307,8 @@ void play_loop(oshu::audio *audio, oshu::sample *sample, float volume);
  *
  * It is similar to #oshu::seek_stream, with the different that this function
  * locks the audio thread, and stops all the currently playing sound effects,
- * which is definitely what you want.
+ * which is definitely what you want. The commands not yet executed by the
+ * audio thread are dropped too.
  */
 int seek_music(oshu::audio *audio, double target);
 
@@ -0,0 +1,70 @@
+/**
+ * \file audio/mix.h
+ * \ingroup audio_mix
+ */
+
+#pragma once
+
+namespace oshu {
+
+/**
+ * \defgroup audio_mix Mix
+ * \ingroup audio
+ *
+ * \brief
+ * Vectorized kernels for mixing and clipping float samples.
+ *
+ * The audio callback adds up to 17 tracks on top of the music, then clips the
+ * result, for every buffer SDL requests. These loops are the only real work
+ * left in the callback, so they're written with SIMD instructions.
+ *
+ * Each kernel comes in three flavors: a scalar one, which works everywhere,
+ * one using SSE2, which every x86-64 processor supports, and one using AVX2
+ * and FMA. The best one the processor supports is picked when the program
+ * starts.
+ *
+ * \{
+ */
+
+/**
+ * The instruction sets the kernels can use.
+ */
+enum mix_kernel {
+	SCALAR_KERNEL = 0,
+	SSE2_KERNEL,
+	AVX2_KERNEL,
+};
+
+/**
+ * Compute `samples[i] += volume * input[i]` for every *i* below *count*.
+ *
+ * *count* is a number of floats, so twice the number of samples per channel
+ * for stereo.
+ */
+void mix_samples(float *samples, const float *input, float volume, int count);
+
+/**
+ * Clamp every float of *samples* between -1 and 1.
+ *
+ * *count* is a number of floats, like for #oshu::mix_samples.
+ */
+void clip_samples(float *samples, int count);
+
+/**
+ * Return the kernel currently in use.
+ */
+oshu::mix_kernel get_mix_kernel();
+
+/**
+ * Use another kernel, mostly to compare them in benchmarks.
+ *
+ * Don't call it while the audio is playing.
+ *
+ * \return 0 on success, -1 if the processor doesn't support the kernel, in
+ * which case the current kernel is kept.
+ */
+int set_mix_kernel(oshu::mix_kernel kernel);
+
+/** \} */
+
+}
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /*
  * Forward declaration of the ffmpeg structures to avoid including big headers.
  */
@@ -17,6 +19,8 @@ struct SwrContext;
 
 namespace oshu {
 
+struct stream_buffer;
+
 /**
  * \defgroup audio_stream Stream
  * \ingroup audio
@@ -50,6 +54,34 @@ namespace oshu {
  * }
  * \enddot
  *
+ * ### Background decoding
+ *
+ * The stream is read from SDL's audio callback, which runs in a real-time
+ * thread and must return quickly. A page that takes long to read or decode
+ * would make the sound card run out of samples, so the decoding doesn't happen
+ * there.
+ *
+ * Instead, #oshu::open_stream starts a thread that decodes the stream ahead of
+ * the playback into a ring of chunks, see #oshu::stream_buffer. That thread is
+ * the only producer, and #oshu::read_stream the only consumer. They share no
+ * lock, so reading the stream only copies samples out of the ring.
+ *
+ * ### Predecoding
+ *
+ * Most tracks are only a few minutes long, and fit in memory once decoded. When
+ * the decoded stream is estimated to fit in the budget set by the
+ * `OSHU_PREDECODE_BUDGET` environment variable, #oshu::open_stream decodes it
+ * completely into #oshu::stream::samples, and no thread is started. Reading
+ * then copies from that buffer, and seeking only moves a cursor.
+ *
+ * The budget is expressed in MiB, and defaults to 128 MiB. At 44.1 kHz, a
+ * minute of stereo float samples takes about 20 MiB, so that's a track of 6
+ * minutes. 0 disables predecoding.
+ *
+ * The predecoded samples are saved to a cache on disk, and the next time the
+ * same audio file is opened, they are mapped in memory without decoding
+ * anything.
+ *
  * \{
  */
 
@@ -132,31 +164,87 @@ struct stream {
 	 * The current temporal position in the playing stream, expressed in
 	 * floating seconds.
 	 *
+	 * This is the position of the next sample #oshu::read_stream will
+	 * return, and not the position of the decoder, which is ahead.
+	 *
+	 * Every decoded chunk carries the timestamp of its first sample, and
+	 * this field is interpolated from it as the chunk is read.
+	 */
+	double current_timestamp;
+	/**
+	 * True when the end of the stream is reached.
+	 *
+	 * Set to 1 by #oshu::read_stream once the decoder reached the end of
+	 * the stream, and every sample it produced was read.
+	 */
+	int finished;
+	/**
+	 * The temporal position of the decoder, in seconds.
+	 *
 	 * Sometimes the best-effort timestamp computed from a frame is
 	 * erroneous. Rather than break everything, let's try to rely on the
 	 * previous frame's timestamp, and therefore keep the timestamp in our
 	 * structure, rather than using only ffmpeg's AVFrame.
 	 *
 	 * In order to do that, the frame decoding routine will update the
-	 * #current_timestamp field whenever it reads a frame with a reasonable
+	 * #decoded_timestamp field whenever it reads a frame with a reasonable
 	 * timestamp. It is computed from libavcodec's `best_effort_timestamp`,
 	 * which means it was be multiplied by the time base in order to get a
 	 * duration in seconds.
+	 *
+	 * Like the rest of the decoding state below, it belongs to the decoding
+	 * thread.
 	 */
-	double current_timestamp;
+	double decoded_timestamp;
 	/**
-	 * How many samples per channel of the current #frame we've read using
-	 * #oshu::read_stream. When this number is bigger than the number of
-	 * samples per channel in the frame, we must request a new frame.
+	 * How many samples per channel of the current #frame we've decoded.
+	 * When this number is bigger than the number of samples per channel in
+	 * the frame, we must request a new frame.
 	 */
 	int sample_index;
 	/**
-	 * True when the end of the stream is reached.
+	 * True when the decoder returned its last frame, or failed.
 	 *
-	 * Set to 1 by #oshu::read_stream when we receive an AVERROR_EOF code
-	 * while trying to read a frame.
+	 * The samples decoded until then may still be waiting in the #buffer.
 	 */
-	int finished;
+	int eof;
+	/**
+	 * The decoding thread and the chunks it decoded ahead.
+	 *
+	 * It is opaque outside of the stream module, and null when the stream
+	 * was predecoded.
+	 */
+	oshu::stream_buffer *buffer;
+	/**
+	 * The whole stream, as packed stereo float samples, when it was
+	 * predecoded. Null otherwise.
+	 */
+	float *samples;
+	/**
+	 * The number of samples per channel in #samples.
+	 */
+	int nb_samples;
+	/**
+	 * The timestamp of the first sample in #samples, in seconds.
+	 *
+	 * It is usually 0, but some containers start the stream a bit later.
+	 */
+	double start_timestamp;
+	/**
+	 * The position of the reader in #samples, in samples per channel.
+	 */
+	int cursor;
+	/**
+	 * The mapping of the decoded audio cache, when #samples were loaded
+	 * from it, or null. #samples then point inside it.
+	 *
+	 * See audio/cache.h.
+	 */
+	char *mapping;
+	/**
+	 * Size of #mapping, in bytes.
+	 */
+	size_t mapping_size;
 };
 
 /**
@@ -165,6 +253,10 @@ struct stream {
  * \param url Path or URL to the media you want to play.
  * \param stream A null-initialized stream object.
  *
+ * If the stream fits in the predecoding budget, it is loaded from its cache,
+ * or entirely decoded and cached before this function returns. Otherwise,
+ * only its beginning is, and the rest is decoded in the background.
+ *
  * \sa oshu::close_stream
  */
 int open_stream(const char *url, oshu::stream *stream);
@@ -179,10 +271,17 @@ int open_stream(const char *url, oshu::stream *stream);
  * The *samples* output buffer size must be at least `nb_samples * 2 *
  * sizeof(float)` bytes, because we're forcing stereo.
  *
+ * This function only copies samples that were already decoded, either
+ * predecoded or produced by the decoding thread, and never blocks, which
+ * makes it safe to call from the audio callback. It must not be called from
+ * more than one thread at a time.
+ *
  * \return
- * The number of samples read per channel. If it is less than *nb_samples*, it
- * means the end of the stream was reached, and further calls to this function
- * will return 0. On error, return -1.
+ * The number of samples read per channel. It is less than *nb_samples* when
+ * the end of the stream was reached, in which case
+ * #oshu::stream::finished is set, or when the decoder is late. The latter
+ * should not happen, but when it does, the playback position doesn't move
+ * until the decoder catches up.
  *
  * \sa oshu::stream::finished
  */
@@ -196,7 +295,16 @@ int read_stream(oshu::stream *stream, float *samples, int nb_samples);
  * To determine the new position of the stream after seeking, use
  * #oshu::stream::current_timestamp.
  *
- * You should probably use #oshu::seek_music instead.
+ * For predecoded streams, this only moves the cursor.
+ *
+ * Otherwise, the samples decoded ahead are dropped, and a few chunks are
+ * decoded from the new position before returning, so that the playback
+ * resumes immediately.
+ * Because it resets the read side of the buffer, #oshu::read_stream must not
+ * be running at the same time.
+ *
+ * You should probably use #oshu::seek_music instead, which takes care of
+ * that.
  *
  * \todo
  * There's often some kind of audio distortion glitch right after seeking.
@@ -206,6 +314,8 @@ int seek_stream(oshu::stream *stream, double target);
 
 /**
  * Close an audio stream, and free everything we can.
+ *
+ * The decoding thread is stopped first.
  */
 void close_stream(oshu::stream *stream);
 
@@ -91,8 +91,8 @@ void stop_track(oshu::track *track);
  *
  * The operation performed for mixing the samples is called multiply-accumulate
  * (MAC) and when dealing with audio, there are specialized hardware units to
- * handle it. The *fmaf* function in math.h should be able to perform the
- * operation in a single step, with less rounding error.
+ * handle it. It is performed by #oshu::mix_samples, which uses the fused
+ * multiply-add instructions of the processor when it has them.
  *
  * \return
  * The number of samples per channel that were added to the buffer. It may be 0
@@ -6,10 +6,14 @@
 #pragma once
 
 #include "beatmap/path.h"
+#include "core/arena.h"
+
+#include <stddef.h>
 
 namespace oshu {
 
 struct texture;
+struct path_prefetcher;
 
 /** \defgroup beatmap Beatmap
  *
@@ -188,6 +192,15 @@ struct timing_point {
 	 * sliders.
 	 */
 	double beat_duration;
+	/**
+	 * \brief Beat duration of the last non-inherited timing point, in
+	 * seconds.
+	 *
+	 * It's the same as #beat_duration, unless this point is inherited.
+	 * The speed multiplier changes how fast the slider ball moves, but
+	 * not the rhythm of the slider ticks, which follow this duration.
+	 */
+	double base_beat_duration;
 	/**
 	 * \brief Number of beats in a measure.
 	 */
@@ -233,6 +246,33 @@ struct timing_point {
 	oshu::timing_point *next;
 };
 
+/**
+ * \brief Time-sorted array of the timing points.
+ *
+ * The timing points are in chronological order in the linked list already,
+ * but finding the one in effect at a given time means walking the list from
+ * the beginning. Beatmaps with many inherited timing points, changing the
+ * slider velocity every few beats, have thousands of them.
+ *
+ * The index lets #oshu::timing_point_at find it with a binary search instead.
+ * It is allocated from the beatmap's arena, and never changes once the
+ * beatmap is loaded.
+ */
+struct timing_index {
+	/**
+	 * Number of timing points.
+	 */
+	int size;
+	/**
+	 * The timing points, in the same order as the linked list.
+	 */
+	oshu::timing_point **points;
+	/**
+	 * Copy of #oshu::timing_point::offset, sorted.
+	 */
+	double *offsets;
+};
+
 /**
  * Flags defining the type of a hit object.
  *
@@ -400,6 +440,37 @@ struct slider {
 	 * same circle will change every time it is repeated.
 	 */
 	oshu::hit_sound *sounds;
+	/**
+	 * Time in seconds when the slider ends, like #oshu::hit_end_time.
+	 */
+	double end_time;
+	/**
+	 * Times when the ball reaches each end of the slider, in seconds.
+	 *
+	 * `edges[0]` is the #oshu::hit::time, and `edges[repeat]` is the
+	 * #end_time. In between are the times when the ball turns back, which
+	 * is also when the matching #sounds are played.
+	 *
+	 * The size of the array is #repeat + 1, like #sounds.
+	 */
+	double *edges;
+	/**
+	 * Times of the slider ticks, in seconds, sorted.
+	 *
+	 * There's one tick every `base_beat_duration / slider_tick_rate`
+	 * seconds, counting from the start of every run. Ticks on a reversed
+	 * run are at the same place on the path as on a forward run. Ticks
+	 * too close to the end of a run are dropped, like the official
+	 * client does.
+	 *
+	 * \sa oshu::timing_point::base_beat_duration
+	 * \sa oshu::difficulty::slider_tick_rate
+	 */
+	double *ticks;
+	/**
+	 * Size of the #ticks array.
+	 */
+	int tick_count;
 };
 
 /**
@@ -557,6 +628,13 @@ struct hit {
 	 * NULL if it's the last element.
 	 */
 	oshu::hit *next;
+	/**
+	 * Position of the hit in the arrays of the beatmap's
+	 * #oshu::beatmap::hit_index.
+	 *
+	 * The first unreachable hit object is at index 0.
+	 */
+	int index;
 };
 
 /**
@@ -567,6 +645,22 @@ struct hit {
  */
 double hit_end_time(oshu::hit *hit);
 
+/**
+ * Find which run of a slider the ball is on at *time*.
+ *
+ * Return an index between 0 and `repeat - 1`, from the slider's
+ * #oshu::slider::edges, clamping the times outside the slider.
+ */
+int slider_run(const oshu::hit *hit, double time);
+
+/**
+ * Compute the position of the slider ball at *time*.
+ *
+ * The time is clamped to the slider's duration, so the ball waits at the start
+ * before the slider begins, and at the end once it's over.
+ */
+oshu::point slider_ball(oshu::hit *hit, double time);
+
 /**
  * Compute the last point of a hit object.
  *
@@ -576,14 +670,100 @@ double hit_end_time(oshu::hit *hit);
  */
 oshu::point end_point(oshu::hit *hit);
 
+/**
+ * \brief Time-sorted index of the hit objects, as a structure of arrays.
+ *
+ * Walking the linked list of hit objects means jumping from one big #oshu::hit
+ * to the next, while the game and the display mostly look at a handful of
+ * fields. The index copies these fields into separate contiguous arrays,
+ * where element *i* of every array describes the same hit object, `hits[i]`.
+ *
+ * Since the arrays are sorted by time, finding the hit objects around a given
+ * time is a binary search, and scanning a time window only touches the arrays
+ * it needs.
+ *
+ * The two unreachable hit objects enclosing the linked list are indexed too, at
+ * 0 and *size - 1*, so that every search lands on a valid hit.
+ *
+ * Everything is allocated from the beatmap's arena. Except for #states, the
+ * arrays never change once the beatmap is loaded.
+ */
+struct hit_index {
+	/**
+	 * Number of elements in each array, including the two unreachable hit
+	 * objects.
+	 */
+	int size;
+	/**
+	 * The hit objects themselves, such that `hits[i]->index == i`.
+	 */
+	oshu::hit **hits;
+	/**
+	 * Copy of #oshu::hit::time, sorted.
+	 */
+	double *times;
+	/**
+	 * Copy of #oshu::hit_end_time.
+	 *
+	 * Unlike #times, they are not sorted, since a slider may end after
+	 * the beginning of the next hit.
+	 */
+	double *end_times;
+	/**
+	 * Running maximum of the #end_times.
+	 *
+	 * `reach[i]` is the latest end time among the hit objects 0 to *i*.
+	 * Contrary to the end times themselves, it is sorted, which makes it
+	 * possible to find the first hit object that's not over at a given
+	 * time with a binary search.
+	 */
+	double *reach;
+	/**
+	 * Copy of #oshu::hit::p.
+	 */
+	oshu::point *points;
+	/**
+	 * Copy of #oshu::hit::type.
+	 */
+	int *types;
+	/**
+	 * Mirror of #oshu::hit::state.
+	 *
+	 * To keep it up to date, the game must change the state of a hit with
+	 * #oshu::set_hit_state.
+	 */
+	enum oshu::hit_state *states;
+};
+
+/**
+ * Find the last hit object whose time is before or equal to *time*.
+ *
+ * Return its position in the index. Because of the first unreachable hit
+ * object, there's always one.
+ */
+int find_last_hit(const oshu::hit_index *index, double time);
+
+/**
+ * Find the first hit object that ends at or after *time*.
+ *
+ * Return its position in the index. Because of the last unreachable hit
+ * object, there's always one.
+ *
+ * For long notes like sliders, the end time is used, so a slider that began
+ * before *time* but isn't over yet may be returned.
+ */
+int find_active_hit(const oshu::hit_index *index, double time);
+
 /**
  * \brief Complete definition of the [Metadata] section.
  *
- * Every character string inside this section is either NULL or a reference to
- * a dynamically allocated string.
+ * Every character string inside this section is either NULL or a view into
+ * the beatmap's #oshu::beatmap::mapping, null-terminated in place by the
+ * parser. When the beatmap was loaded from its cache, the strings live in the
+ * beatmap's #oshu::beatmap::arena instead.
  *
- * This structure should *own* the strings it references, so make sure you
- * `strdup` your strings before filling it.
+ * This structure does not own the strings it references. Never free them, and
+ * don't use them after the beatmap is destroyed.
  *
  * All the strings are encoded in UTF-8.
  */
@@ -786,8 +966,8 @@ struct difficulty {
  * It also focuses on ease of use by SDL when rendering rather than providing
  * an accurate abstract syntax tree of the original file.
  *
- * Most string values are dynamically allocated inside this structure. Some
- * linked structures are allocated on the heap too. Make sure you free
+ * Most string values point inside the memory-mapped beatmap file, and all the
+ * linked structures are allocated from the beatmap's #arena. Make sure you free
  * everything with #oshu::destroy_beatmap.
  */
 struct beatmap {
@@ -814,6 +994,8 @@ struct beatmap {
 	 *
 	 * It is obviously mandatory, and a file missing that field should
 	 * trigger a parsing error.
+	 *
+	 * Like the metadata strings, it points inside #mapping.
 	 */
 	char *audio_filename;
 	/**
@@ -877,7 +1059,7 @@ struct beatmap {
 	 * The section may contain other effects and break information, but
 	 * until we figure it out, let's keep only this crucial property.
 	 *
-	 * May be NULL.
+	 * May be NULL. Otherwise, it points inside #mapping.
 	 */
 	char *background_filename;
 	/**
@@ -886,6 +1068,10 @@ struct beatmap {
 	 * It's a linked list, in chronological order.
 	 */
 	oshu::timing_point *timing_points;
+	/**
+	 * \brief Index of the #timing_points, for #oshu::timing_point_at.
+	 */
+	oshu::timing_index timing_index;
 	/**
 	 * \brief [Colours] section.
 	 *
@@ -908,18 +1094,94 @@ struct beatmap {
 	 * the first object, and *+INFINITY* for the last one; and also the
 	 * *next* and *previous* pointers. This lets you ensure your hit cursor
 	 * is never null.
+	 *
+	 * The hit objects are allocated from the #arena, in a single array
+	 * reserved when the parser enters the [HitObjects] section, so
+	 * following the list walks the memory forward.
 	 */
 	oshu::hit *hits;
+	/**
+	 * \brief Structure-of-arrays index of the #hits.
+	 *
+	 * It is built once the parsing is complete, and covers the same hit
+	 * objects as the linked list, sentinels included.
+	 */
+	oshu::hit_index hit_index;
+	/**
+	 * \brief Memory of every object the parser allocated.
+	 *
+	 * This includes the timing points, the colors, the hit objects, and
+	 * the slider sounds and paths. They are all released at once by
+	 * #oshu::destroy_beatmap.
+	 */
+	oshu::arena arena;
+	/**
+	 * \brief Private memory mapping of the beatmap file.
+	 *
+	 * The parser reads the file straight from that mapping, and terminates
+	 * the strings it keeps in place, which is possible because the mapping
+	 * is private and writable. Nothing is ever written back to the file.
+	 *
+	 * The mapping is one byte larger than #mapping_size, and that extra
+	 * byte is always zero, so that the last line is null-terminated even
+	 * when the file doesn't end with a newline.
+	 *
+	 * It is unmapped by #oshu::destroy_beatmap.
+	 *
+	 * NULL when the beatmap was loaded from its compiled cache, as the
+	 * file is then not parsed at all.
+	 */
+	char *mapping;
+	/**
+	 * Size of the beatmap file, in bytes.
+	 */
+	size_t mapping_size;
+	/**
+	 * \brief Background thread normalizing the slider paths, if any.
+	 *
+	 * See #oshu::prefetch_paths. It is stopped by
+	 * #oshu::destroy_beatmap.
+	 */
+	oshu::path_prefetcher *prefetcher;
 };
 
 /**
- * Take a path to a `.osu` file, open it and parse it.
+ * Take a path to a `.osu` file, map it in memory and parse it.
+ *
+ * The file is mapped once and never read line by line, and the strings of the
+ * beatmap are not copied but point inside the mapping. See
+ * #oshu::beatmap::mapping.
+ *
+ * When the beatmap was saved to the cache with #oshu::cache_beatmap, that
+ * cache is read instead of parsing the file again, as long as the beatmap file
+ * keeps the same modification time and size.
  *
  * On failure, the content of *beatmap* is undefined, but any dynamically
  * allocated internal memory is freed.
  */
 int load_beatmap(const char *path, oshu::beatmap *beatmap);
 
+/**
+ * Save a beatmap freshly parsed by #oshu::load_beatmap to a binary cache, for
+ * the next #oshu::load_beatmap of *path* to skip the parser.
+ *
+ * The cache lives in `$XDG_CACHE_HOME/oshu/beatmaps`, or
+ * `$HOME/.cache/oshu/beatmaps`, in a file named after a hash of the real path
+ * of the beatmap, so the song folders are never written to.
+ *
+ * Every slider path is normalized before it is saved, so that the next load
+ * gets them ready. The game may keep playing the beatmap meanwhile, as the
+ * state, offset and texture of the hits are not saved.
+ *
+ * Normalizing the paths and writing the file takes longer than parsing the
+ * beatmap, so only save the beatmaps that are likely to be loaded again, like
+ * the one being played, and rather from the thread of #oshu::prefetch_paths
+ * than at startup. This does nothing when the beatmap was itself loaded from
+ * the cache. Failing to write the cache is not an error, and only logs a
+ * warning.
+ */
+void cache_beatmap(const char *path, oshu::beatmap *beatmap);
+
 /**
  * Parse the first sections of a beatmap to get the metadata and difficulty
  * information.
@@ -942,10 +1204,226 @@ int load_beatmap(const char *path, oshu::beatmap *beatmap);
 int load_beatmap_headers(const char *path, oshu::beatmap *beatmap);
 
 /**
- * Free any object dynamically allocated inside the beatmap.
+ * Quickly read the few fields needed to list a beatmap in a library.
+ *
+ * This function only loads:
+ *
+ * - #oshu::beatmap::version,
+ * - #oshu::beatmap::mode,
+ * - #oshu::metadata::title,
+ * - #oshu::metadata::artist,
+ * - #oshu::metadata::version,
+ * - #oshu::difficulty::overall_difficulty.
+ *
+ * The other fields keep their default values, and there are no hit objects
+ * at all, not even the unreachable ones.
+ *
+ * Unlike #oshu::load_beatmap_headers, it doesn't run the parser. It skips
+ * from line to line looking for these keys only, and stops as soon as it
+ * found all of them, usually somewhere in the [Difficulty] section. Only the
+ * first few KiB of the file are read, unless the keys are further. It fails
+ * if the title, artist or version is missing.
+ *
+ * Release the beatmap with #oshu::destroy_beatmap.
+ */
+int scan_beatmap(const char *path, oshu::beatmap *beatmap);
+
+/**
+ * Load many beatmaps at once, concurrently.
+ *
+ * Each beatmap is loaded with #oshu::load_beatmap, in a pool of threads
+ * sized after the number of processors. The parser keeps no global state,
+ * which makes it safe to load many beatmaps in parallel.
+ *
+ * *beatmaps* and *status* must both have room for *count* elements. The
+ * beatmap at `paths[i]` is loaded into `beatmaps[i]`, and `status[i]` is set to
+ * 0 on success, or -1 on failure. A failed beatmap is left zeroed, so calling
+ * #oshu::destroy_beatmap on every element afterwards is always fine.
+ *
+ * Every beatmap stays in memory, with its mapping, until it is destroyed. To
+ * go through a whole library, call this function on bounded chunks of paths,
+ * destroying the beatmaps of a chunk before loading the next one.
+ *
+ * Return the number of beatmaps that were loaded successfully.
+ */
+int load_beatmaps(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status);
+
+/**
+ * Like #oshu::load_beatmaps, but only load the headers of the beatmaps, with
+ * #oshu::load_beatmap_headers.
+ *
+ * To list the beatmaps of a library, #oshu::scan_beatmaps is faster.
+ */
+int load_beatmaps_headers(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status);
+
+/**
+ * Like #oshu::load_beatmaps, but only scan the beatmaps with
+ * #oshu::scan_beatmap.
+ */
+int scan_beatmaps(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status);
+
+/**
+ * Parse a beatmap from a buffer in memory, containing the text of a `.osu`
+ * file.
+ *
+ * This is what #oshu::load_beatmap does after mapping the file, for beatmaps
+ * that don't come from a file, like an archive member or the standard input.
+ *
+ * The buffer doesn't need to be null-terminated. It is copied once into the
+ * beatmap's arena, where the parser terminates its strings in place, so the
+ * caller may release the buffer as soon as this function returns. The beatmap
+ * has no #oshu::beatmap::mapping, and no cache is involved.
+ *
+ * On failure, the content of *beatmap* is undefined, but any dynamically
+ * allocated internal memory is freed.
+ */
+int parse_beatmap(const char *buffer, size_t size, oshu::beatmap *beatmap);
+
+/**
+ * Parse the first sections of a beatmap from a buffer in memory.
+ *
+ * This is to #oshu::parse_beatmap what #oshu::load_beatmap_headers is to
+ * #oshu::load_beatmap.
+ */
+int parse_beatmap_headers(const char *buffer, size_t size, oshu::beatmap *beatmap);
+
+/**
+ * Receive the objects of a beatmap as #oshu::feed_beatmap_stream parses them.
+ *
+ * Override the methods for the events you're interested in. The default
+ * implementations do nothing.
+ *
+ * The beatmap passed to every method is the one being filled, in the state the
+ * parser left it so far. For example, once the [Difficulty] section is
+ * complete, its settings are final, and the textures of the hit objects may be
+ * prepared while the rest of the beatmap is still arriving.
+ */
+struct beatmap_listener {
+	virtual ~beatmap_listener() = default;
+	/**
+	 * Called when a section is complete, with its name as it appears in
+	 * the beatmap, like `Metadata`.
+	 *
+	 * A section is complete when the next one begins, or when the stream is
+	 * closed.
+	 */
+	virtual void section(oshu::beatmap&, const char*) {}
+	/**
+	 * Called for every timing point, once it is linked to the previous
+	 * ones.
+	 */
+	virtual void timing_point(oshu::beatmap&, oshu::timing_point*) {}
+	/**
+	 * Called for every hit object, once it is linked to the previous ones.
+	 *
+	 * When #keep_hits is false, the hit object and its path are only valid
+	 * until this method returns.
+	 */
+	virtual void hit(oshu::beatmap&, oshu::hit*) {}
+	/**
+	 * Whether the hit objects should be kept in the beatmap.
+	 *
+	 * Tools that only need to look at each hit object once may set it to
+	 * false, so that the memory used by the parser stays constant however
+	 * long the input is. The beatmap then ends up with no hit objects but
+	 * the two unreachable ones.
+	 */
+	bool keep_hits = true;
+};
+
+/**
+ * State of an incremental parser, opaque.
+ */
+struct beatmap_stream;
+
+/**
+ * Start parsing a beatmap incrementally.
+ *
+ * Instead of receiving the whole file at once like #oshu::parse_beatmap, the
+ * parser is fed arbitrary chunks with #oshu::feed_beatmap_stream, and reports
+ * its progress to *listener* as the lines complete. #oshu::close_beatmap_stream
+ * finishes the parsing and releases the stream.
+ *
+ * The listener may be NULL, and must outlive the stream otherwise.
+ *
+ * The input doesn't need to be held in memory: only the incomplete last line
+ * of a chunk is kept until the next one arrives. The strings of the beatmap
+ * are copied into its arena, as it has no #oshu::beatmap::mapping.
+ */
+oshu::beatmap_stream* open_beatmap_stream(oshu::beatmap *beatmap, oshu::beatmap_listener *listener);
+
+/**
+ * Parse the next *size* bytes of the beatmap.
+ *
+ * Lines may be split across chunks anywhere.
+ *
+ * Return -1 if the input was found not to be a beatmap, in which case the next
+ * calls will fail too. Errors on single lines are only logged, like
+ * #oshu::load_beatmap does.
+ */
+int feed_beatmap_stream(oshu::beatmap_stream *stream, const char *data, size_t size);
+
+/**
+ * Parse the last line, complete the beatmap and release the stream.
+ *
+ * Return 0 if the beatmap is valid. Otherwise, return -1 and free any
+ * dynamically allocated memory of the beatmap.
+ */
+int close_beatmap_stream(oshu::beatmap_stream *stream);
+
+/**
+ * Free any object dynamically allocated inside the beatmap, and unmap the
+ * beatmap file.
+ *
+ * Every string of the beatmap is invalidated.
  */
 void destroy_beatmap(oshu::beatmap *beatmap);
 
+/**
+ * Start normalizing every slider path of the beatmap in a background thread.
+ *
+ * The parser leaves the paths raw, and they are normalized the first time
+ * #oshu::path_at needs them, which happens when the slider enters the approach
+ * window. Normalizing a long Bézier path is not free, so this function lets
+ * the game get it done ahead of time, in chronological order, while the
+ * player is still looking at the first hit objects. A path the game needs
+ * before the thread reaches it is simply normalized on the spot.
+ *
+ * When *path* is not NULL, the thread then saves the beatmap with
+ * #oshu::cache_beatmap, once every path is normalized, so that the cache is
+ * written without delaying the start of the game.
+ *
+ * The beatmap must be fully loaded, and must not be moved while the thread is
+ * running. Calling this function again has no effect.
+ */
+void prefetch_paths(oshu::beatmap *beatmap, const char *path);
+
+/**
+ * Stop and join the thread started by #oshu::prefetch_paths, if any.
+ *
+ * The paths it didn't get to are left raw, and the beatmap is not cached.
+ * #oshu::destroy_beatmap calls this function.
+ */
+void cancel_path_prefetch(oshu::beatmap *beatmap);
+
+/**
+ * Find the timing point in effect at *time*.
+ *
+ * That's the last timing point whose offset is before or equal to *time*.
+ * Before the first timing point, the first one applies.
+ *
+ * Return NULL only when the beatmap has no timing points at all.
+ */
+oshu::timing_point* timing_point_at(const oshu::beatmap *beatmap, double time);
+
+/**
+ * Change the state of a hit object, keeping the beatmap's
+ * #oshu::beatmap::hit_index in sync.
+ *
+ * Always use this function instead of writing #oshu::hit::state directly.
+ */
+void set_hit_state(oshu::beatmap *beatmap, oshu::hit *hit, enum oshu::hit_state state);
+
 /** \} */
 
 }
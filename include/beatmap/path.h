@@ -7,6 +7,8 @@
 
 #include "core/geometry.h"
 
+#include <atomic>
+
 namespace oshu {
 
 /**
@@ -155,9 +157,8 @@ struct bezier {
 	 * To reuse the example in #oshu::bezier, since all the segments are
 	 * quadratic, the indices are [0, 3, 6, 9].
 	 *
-	 * The size of the indices array must be *segment_count + 1*.
-	 *
-	 * For the normalization process, it must be dynamically allocated.
+	 * The size of the indices array must be *segment_count + 1*, plus one
+	 * extra slot as long as the path is not #extended.
 	 *
 	 * \sa segment_count
 	 * \sa control_points
@@ -178,23 +179,111 @@ struct bezier {
 	 * To identify the segments these points belong to, you need to use the
 	 * #indices array.
 	 *
-	 * Its length is specified in `indices[segment_count]`.
-	 *
-	 * For the normalization process, it must be dynamically allocated.
+	 * Its length is specified in `indices[segment_count]`. Until the path
+	 * is #extended, the array has room for two more points.
 	 */
 	oshu::point *control_points;
 	/**
-	 * Translation map from l-coordinates to t-coordinates.
+	 * Whether the normalization appended an extra linear segment to the
+	 * path, because it was too short.
 	 *
-	 * Let's say we have n pieces, and n+1 anchors. Then for every 0 ≤ i ≤ n,
-	 * `anchors[i]` holds the t-coordinate for the point at l = i / n.
+	 * The parser reserves room for that segment in #indices and
+	 * #control_points, so that the normalization never needs to allocate
+	 * memory. If the path is still too short after being extended, the
+	 * extra segment is made longer instead of adding another one.
+	 */
+	bool extended;
+	/**
+	 * Number of points the parser reserved in #samples and #distances.
 	 *
-	 * For any point such that i / n ≤ l ≤ (i + 1) / n, compute a weighted
-	 * average between anchors[i] and anchors[i+1].
+	 * It depends on the length of the slider and on its number of
+	 * segments. When the flattened path would need more points, the
+	 * normalization flattens it more coarsely until it fits.
+	 */
+	int sample_capacity;
+	/**
+	 * Number of points in #samples once the path is normalized, at least 2
+	 * and at most #sample_capacity.
+	 */
+	int sample_count;
+	/**
+	 * \brief The path flattened to a polyline.
+	 *
+	 * The points are picked such that the polyline stays within a fraction
+	 * of a pixel of the curve, and every joint between two segments is
+	 * one of them, so that sharp corners are kept. The straight parts get
+	 * few points, and the tight curves many.
+	 *
+	 * This is what the ball follows, what the slider is drawn from, and
+	 * what the bounding box is computed on, so that they all agree.
+	 *
+	 * The array is allocated by the parser, and filled by the
+	 * normalization.
 	 *
 	 * \sa oshu::normalize_path
 	 */
-	double anchors[64];
+	oshu::point *samples;
+	/**
+	 * \brief The l-coordinate of every point of #samples.
+	 *
+	 * `distances[i]` is the distance from the start to `samples[i]` along
+	 * the polyline, divided by the length of the path. It grows from 0 to
+	 * 1. For any point such that `distances[i] ≤ l ≤ distances[i+1]`,
+	 * compute a weighted average between samples[i] and samples[i+1].
+	 */
+	double *distances;
+};
+
+/**
+ * A Catmull-Rom spline, going through all its control points.
+ *
+ * Used by #oshu::CATMULL_PATH segments.
+ *
+ * Between two consecutive control points `p_i` and `p_(i+1)`, the curve is a
+ * cubic whose tangents are given by the neighbouring points `p_(i-1)` and
+ * `p_(i+2)`. At the ends of the path, the missing neighbours are mirrored,
+ * like the official osu! client does.
+ *
+ * Like #oshu::bezier paths, the normalization flattens the whole path once
+ * into a polyline, so that #oshu::path_at only interpolates between two
+ * neighbouring samples.
+ */
+struct catmull {
+	/**
+	 * Number of control points, including the starting point of the
+	 * slider. There are at least 2.
+	 */
+	int point_count;
+	/**
+	 * The control points, as written in the beatmap, with the slider's
+	 * starting point in front.
+	 */
+	oshu::point *control_points;
+	/**
+	 * Number of points the parser reserved in #samples and #distances,
+	 * which depends on the number of control points.
+	 */
+	int sample_capacity;
+	/**
+	 * Number of points in #samples once the path is normalized, at least 2
+	 * and at most #sample_capacity.
+	 */
+	int sample_count;
+	/**
+	 * \brief The normalized polyline.
+	 *
+	 * Every control point the ball reaches is one of its points. Before the
+	 * path is normalized, the content is unspecified.
+	 *
+	 * The array is allocated by the parser, so that the normalization
+	 * never needs to allocate memory.
+	 */
+	oshu::point *samples;
+	/**
+	 * The l-coordinate of every point of #samples, like
+	 * #oshu::bezier::distances.
+	 */
+	double *distances;
 };
 
 /**
@@ -224,29 +313,73 @@ enum path_type {
  * interesting with the 4-point cubic Bézier curve, which is the one you see in
  * most painting tools. See #oshu::bezier.
  *
- * Catmull paths (#oshu::CATMULL_PATH) are officially deprecated, but we should
- * support them someday in order to support old beatmaps.
+ * Catmull paths (#oshu::CATMULL_PATH) are officially deprecated, but still
+ * appear in old beatmaps. They pass through all their control points. See
+ * #oshu::catmull.
  */
 struct path {
 	enum oshu::path_type type;
+	/**
+	 * \brief Length of the path, in osu!pixels, as specified in the
+	 * beatmap.
+	 *
+	 * This is the length #oshu::normalize_path adjusts the path to.
+	 */
+	double length;
+	/**
+	 * \brief Normalization state, from #oshu::path_state.
+	 *
+	 * The parser stores the paths raw, and they are only normalized the
+	 * first time they are needed, by #oshu::path_at or
+	 * #oshu::path_bounding_box. Because a background thread may
+	 * normalize paths in advance, see #oshu::prefetch_paths, this state
+	 * is atomic.
+	 */
+	std::atomic<int> state;
 	union {
 		oshu::line line; /**< For #oshu::LINEAR_PATH. */
 		oshu::arc arc; /**< For #oshu::PERFECT_PATH. */
 		oshu::bezier bezier; /**< For #oshu::BEZIER_PATH. */
+		oshu::catmull catmull; /**< For #oshu::CATMULL_PATH. */
 	};
 };
 
+/**
+ * Normalization states of a path. See #oshu::path::state.
+ */
+enum path_state {
+	RAW_PATH = 0, /**< As parsed. */
+	NORMALIZING_PATH, /**< Some thread is normalizing it. */
+	NORMALIZED_PATH, /**< Ready for #oshu::path_at. */
+};
+
+/**
+ * Compute how many points to reserve for the polyline of a Bézier or Catmull
+ * path, whose control points and #oshu::path::length are known.
+ *
+ * See #oshu::bezier::sample_capacity and #oshu::catmull::sample_capacity.
+ * Return 0 for the other types, which aren't flattened.
+ */
+int sample_capacity(const oshu::path *path);
+
 /**
  * Adjust the length-related properties of a path.
  *
- * The path described by its control points may not have the same length as the
- * wanted length specified as argument, in which case the path is shrinked or
- * expanded.
+ * The path described by its control points may not have the same length as
+ * #oshu::path::length, in which case the path is shrinked or expanded.
  *
  * In most case, this function will shrink the path, because the actual length
  * is greater than the one specified in the beatmap.
+ *
+ * When a Bézier path is too short, it is expanded with an extra linear
+ * segment. See #oshu::bezier::extended. Catmull paths are extended the same
+ * way, by prolonging their last sample.
+ *
+ * It is safe to call this function many times, and from many threads. Only
+ * the first call does the work, and the other ones wait for it to complete.
+ * You don't usually need to call it yourself, as #oshu::path_at does it.
  */
-void normalize_path(oshu::path *path, double length);
+void normalize_path(oshu::path *path);
 
 /**
  * Express the path in floating t-coordinates.
@@ -288,6 +421,16 @@ void normalize_path(oshu::path *path, double length);
  */
 oshu::point path_at(oshu::path *path, double t);
 
+/**
+ * Get the polyline a Bézier or Catmull path was flattened to, see
+ * #oshu::bezier::samples.
+ *
+ * Return the number of points, and make *points* point to them. Lines and
+ * arcs are cheap to compute exactly and aren't flattened, so 0 is returned for
+ * them.
+ */
+int path_polyline(oshu::path *path, const oshu::point **points);
+
 /**
  * Compute the smallest box such that the path fits in.
  *
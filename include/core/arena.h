@@ -0,0 +1,115 @@
+/**
+ * \file include/core/arena.h
+ * \ingroup core_arena
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace oshu {
+
+/**
+ * \defgroup core_arena Arena
+ * \ingroup core
+ *
+ * \brief
+ * Bump allocator for objects sharing the same lifetime.
+ *
+ * An arena hands out memory by moving a cursor forward in big blocks obtained
+ * from the heap. Allocating is therefore only a pointer increment in the
+ * common case, and objects allocated one after the other are contiguous in
+ * memory.
+ *
+ * There's no way to free a single object. Instead, everything is released at
+ * once with #oshu::destroy_arena. This fits the beatmap well, whose thousands
+ * of hit objects are all created by the parser and all destroyed with the
+ * beatmap.
+ *
+ * A zero-initialized #oshu::arena is a valid empty arena.
+ *
+ * ```c
+ * oshu::arena arena {};
+ * oshu::hit *hit = (oshu::hit*) oshu::arena_alloc(&arena, sizeof(*hit));
+ * oshu::destroy_arena(&arena);
+ * ```
+ *
+ * \{
+ */
+
+/**
+ * Header of a block of memory owned by an arena.
+ *
+ * The usable memory follows the header, which is padded to keep it aligned.
+ */
+struct arena_block {
+	/**
+	 * The previously allocated block, or NULL for the first one.
+	 */
+	oshu::arena_block *previous;
+	/**
+	 * End of the memory handed out from this block.
+	 *
+	 * It is set when the block stops being the current one, that is when
+	 * the next block is allocated. The current block ends at
+	 * #oshu::arena::cursor instead.
+	 */
+	char *end;
+};
+
+struct arena {
+	/**
+	 * The block we're currently allocating from, linked to the older
+	 * blocks.
+	 *
+	 * NULL when nothing was allocated yet.
+	 */
+	oshu::arena_block *blocks;
+	/**
+	 * Next free byte in the current block.
+	 */
+	char *cursor;
+	/**
+	 * End of the current block.
+	 *
+	 * When the object to allocate doesn't fit between #cursor and #end, a
+	 * new block is allocated.
+	 */
+	char *end;
+};
+
+/**
+ * Allocate *size* bytes of zeroed memory from the arena.
+ *
+ * The memory is suitably aligned for any type, like *malloc*'s, and lives
+ * until the arena is destroyed.
+ *
+ * Requests bigger than the default block size get a block of their own.
+ *
+ * This function never returns NULL, and aborts if the system is out of
+ * memory.
+ */
+void* arena_alloc(oshu::arena *arena, size_t size);
+
+/**
+ * Release all the memory of the arena at once.
+ *
+ * Every pointer returned by #oshu::arena_alloc becomes invalid, and the arena
+ * is reset to an empty state, ready to be reused.
+ */
+void destroy_arena(oshu::arena *arena);
+
+/**
+ * Release all the objects of the arena at once, but keep its most recent
+ * block to allocate the next objects from.
+ *
+ * This makes an arena suitable for short-lived objects that are allocated
+ * and released over and over, without going back to the heap every time.
+ *
+ * Every pointer returned by #oshu::arena_alloc becomes invalid.
+ */
+void clear_arena(oshu::arena *arena);
+
+/** \} */
+
+}
@@ -0,0 +1,47 @@
+/**
+ * \file include/core/cache.h
+ * \ingroup core_cache
+ */
+
+#pragma once
+
+#include <string>
+
+namespace oshu {
+
+/**
+ * \defgroup core_cache Cache
+ * \ingroup core
+ *
+ * \brief
+ * Locate the directories where oshu! keeps its caches.
+ *
+ * Following the XDG base directory specification, the caches live in
+ * `$XDG_CACHE_HOME/oshu`, or `$HOME/.cache/oshu` when `XDG_CACHE_HOME` is not
+ * set. Every kind of cache has its own sub-directory there.
+ *
+ * Nothing in these directories is precious, and the user may delete them at
+ * any time.
+ *
+ * \{
+ */
+
+/**
+ * Return the cache directory for the cache called *name*, like `audio`.
+ *
+ * The directory is not created. Return an empty string if neither
+ * `XDG_CACHE_HOME` nor `HOME` are set.
+ */
+std::string cache_directory(const char *name);
+
+/**
+ * Create every missing directory leading to *directory*, and *directory*
+ * itself, like `mkdir -p`.
+ *
+ * Return -1 and set *errno* on failure.
+ */
+int make_directories(const std::string &directory);
+
+/** \} */
+
+}
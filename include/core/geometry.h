@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <cmath>
 #include <complex>
 
 namespace oshu {
@@ -43,6 +44,96 @@ using size = std::complex<double>;
  */
 double ratio(oshu::size size);
 
+/**
+ * Scalar type of #oshu::vec2.
+ *
+ * It is *double* by default, and *float* when oshu! is built with the
+ * `OSHU_FLOAT_GEOMETRY` CMake option, which halves the size of the vectors
+ * and lets the compiler pack twice as many of them in a SIMD register.
+ */
+#ifdef OSHU_FLOAT_GEOMETRY
+using real = float;
+#else
+using real = double;
+#endif
+
+/**
+ * A plain 2D vector, for the computations performed on every frame.
+ *
+ * #oshu::point is a *std::complex*, which is convenient but opaque to the
+ * optimizer: its operations may call into the library, and its modulus uses
+ * *hypot*, which is much slower than a square root as it guards against
+ * overflows we'll never meet with screen coordinates.
+ *
+ * This structure is a POD with inline operations, so that the compiler is
+ * free to keep it in registers and vectorize it. Convert from and to
+ * #oshu::point with #oshu::to_vec2 and #oshu::to_point at the boundaries of
+ * the hot code.
+ */
+struct vec2 {
+	oshu::real x;
+	oshu::real y;
+};
+
+inline oshu::vec2 operator+(oshu::vec2 a, oshu::vec2 b)
+{
+	return {a.x + b.x, a.y + b.y};
+}
+
+inline oshu::vec2 operator-(oshu::vec2 a, oshu::vec2 b)
+{
+	return {a.x - b.x, a.y - b.y};
+}
+
+inline oshu::vec2 operator-(oshu::vec2 a)
+{
+	return {-a.x, -a.y};
+}
+
+inline oshu::vec2 operator*(oshu::vec2 a, oshu::real k)
+{
+	return {a.x * k, a.y * k};
+}
+
+inline oshu::vec2 operator*(oshu::real k, oshu::vec2 a)
+{
+	return {k * a.x, k * a.y};
+}
+
+inline oshu::vec2 operator/(oshu::vec2 a, oshu::real k)
+{
+	return {a.x / k, a.y / k};
+}
+
+/**
+ * Dot product of two vectors.
+ *
+ * The dot product of a vector with itself is its squared length, like
+ * *std::norm* for complex numbers.
+ */
+inline oshu::real dot(oshu::vec2 a, oshu::vec2 b)
+{
+	return a.x * b.x + a.y * b.y;
+}
+
+/**
+ * Euclidean length of a vector, like *std::abs* for complex numbers.
+ */
+inline oshu::real length(oshu::vec2 v)
+{
+	return std::sqrt(oshu::dot(v, v));
+}
+
+inline oshu::vec2 to_vec2(oshu::point p)
+{
+	return {(oshu::real) std::real(p), (oshu::real) std::imag(p)};
+}
+
+inline oshu::point to_point(oshu::vec2 v)
+{
+	return {v.x, v.y};
+}
+
 /* } */
 
 }
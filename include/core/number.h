@@ -0,0 +1,51 @@
+/**
+ * \file include/core/number.h
+ * \ingroup core_number
+ */
+
+#pragma once
+
+namespace oshu {
+
+/**
+ * \defgroup core_number Numbers
+ * \ingroup core
+ *
+ * \brief
+ * Fast number parsing.
+ *
+ * The beatmap parser reads several numbers on every line of a beatmap, and
+ * long beatmaps have thousands of lines. *strtol* and *strtod* are general
+ * enough to handle any base, hexadecimal floats, infinities, and the locale's
+ * decimal separator, which makes them slow for the short decimal numbers
+ * beatmaps contain.
+ *
+ * The functions of this module are drop-in replacements for these two,
+ * specialized for plain decimal numbers like `-12` or `0.125`, and always using
+ * the dot as the decimal separator whatever the locale is. For anything more
+ * exotic, they fall back on the standard library, so they always return exactly
+ * the same value the C locale's *strtol* and *strtod* would.
+ *
+ * \{
+ */
+
+/**
+ * Parse a base-10 integer, like `strtol(str, end, 10)`.
+ *
+ * Leading spaces and a sign are accepted. When no digit is found, return 0
+ * and set *end* to *str*.
+ */
+long read_integer(const char *str, char **end);
+
+/**
+ * Parse a decimal number, like *strtod* in the C locale.
+ *
+ * Numbers with at most 15 significant digits and no exponent are computed
+ * directly, with a single correctly-rounded division, which yields the exact
+ * same double as *strtod*. The other ones are delegated to *strtod*.
+ */
+double read_decimal(const char *str, char **end);
+
+/** \} */
+
+}
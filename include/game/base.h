@@ -105,11 +105,13 @@ public:
 /**
  * Find the first hit object after *now - offset*.
  *
- * It bases the search on the #oshu::game_base::hit_cursor for performance, but its
- * position won't affect the results.
+ * It is a binary search in the beatmap's #oshu::beatmap::hit_index, so the
+ * #oshu::game_base::hit_cursor doesn't matter.
  *
  * For long notes like sliders, the end time is used, not the start time.
  *
+ * \sa oshu::find_active_hit
+ *
  * \sa oshu::look_hit_up
  */
 oshu::hit* look_hit_back(oshu::game_base *game, double offset);
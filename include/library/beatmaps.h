@@ -44,13 +44,18 @@ namespace oshu {
 /**
  * Gather the key information of a beatmap.
  *
- * To save resources, it uses #oshu::load_beatmap_headers.
+ * To save resources, it uses #oshu::scan_beatmap.
  *
  * \todo
  * Reuse the beatmap structure?
  */
 struct beatmap_entry {
 	explicit beatmap_entry(const std::string &path);
+	/**
+	 * Build the entry from a beatmap that was already scanned, for example
+	 * by #oshu::scan_beatmaps.
+	 */
+	beatmap_entry(const std::string &path, const oshu::beatmap &beatmap);
 	oshu::mode mode;
 	/**
 	 * Difficulty indicator.
@@ -81,6 +86,10 @@ struct beatmap_entry {
  */
 struct beatmap_set {
 	explicit beatmap_set(const std::string &path);
+	/**
+	 * Make a set out of entries that were already loaded.
+	 */
+	explicit beatmap_set(std::vector<beatmap_entry> &&entries);
 	/**
 	 * List of beatmap entries inside this set, sorted by difficulty.
 	 */
@@ -88,6 +97,12 @@ struct beatmap_set {
 	bool empty() const;
 	std::string title;
 	std::string artist;
+private:
+	/**
+	 * Sort the entries by difficulty, and take the title and artist of the
+	 * set from its first entry.
+	 */
+	void sort();
 };
 
 /**
@@ -95,6 +110,9 @@ struct beatmap_set {
  *
  * The entries are sorted alphabetically by artist, then by title.
  *
+ * The .osu files of every set are listed first, then all loaded in a single
+ * batch with #oshu::scan_beatmaps, to use every processor.
+ *
  * \warning
  * This function is expensive.
  *
@@ -198,6 +198,11 @@ void reset_view(oshu::display *display);
  */
 oshu::point project(oshu::view *view, oshu::point p);
 
+/**
+ * Project a point like above, with the per-frame #oshu::vec2 type.
+ */
+oshu::vec2 project(oshu::view *view, oshu::vec2 p);
+
 /**
  * Unproject a point from physical coordinates to logical coordinates.
  *
@@ -7,6 +7,7 @@
  */
 
 #include "audio/audio.h"
+#include "audio/mix.h"
 #include "core/log.h"
 
 #include <assert.h>
@@ -21,34 +22,72 @@
 static const int sample_buffer_size = 2048;
 
 /**
- * Clip a buffer of float audio samples to ensure every sample's value is
- * normalized between -1 and 1.
+ * Pick a track for playing sound effects.
  *
- * Without this, some audio cards emit an awful noise.
+ * If one track is inactive, pick it without hesitation. If all the tracks
+ * are active, pick the one with the biggest cursor, because there's a good
+ * chance it's about to end.
+ *
+ * It is called from the audio thread, when executing a command.
  */
-static void clip(float *samples, int nb_samples, int channels)
+static oshu::track *select_track(oshu::audio *audio)
 {
-	for (int i = 0; i < nb_samples * channels; ++i) {
-		if (samples[i] > 1.)
-			samples[i] = 1.;
-		else if (samples[i] < -1.)
-			samples[i] = -1.;
+	int max_cursor = 0;
+	oshu::track *best_track = &audio->effects[0];
+	int tracks = sizeof(audio->effects) / sizeof(*audio->effects);
+	for (int i = 0; i < tracks; ++i) {
+		oshu::track *c = &audio->effects[i];
+		if (c->sample == NULL) {
+			return c;
+		} else if (c->cursor > max_cursor) {
+			max_cursor = c->cursor;
+			best_track = c;
+		}
 	}
+	return best_track;
 }
 
 /**
- * Fill SDL's audio buffer, while requesting more frames as needed.
+ * Execute the queued commands.
  *
- * libavcodec organize frames by channel in planar mode (LLLLRRRR), while we'd
- * like them to be interleaved as SDL requires (LRLRLRLR). This makes a
- * intricate nesting of loops. In that order: frame loop, sample loop, channel
- * loop. Makes sense.
+ * This is the consumer side of #oshu::audio::commands, called by the audio
+ * callback.
+ */
+static void run_commands(oshu::audio *audio)
+{
+	unsigned size = sizeof(audio->commands) / sizeof(*audio->commands);
+	unsigned tail = audio->command_tail.load(std::memory_order_relaxed);
+	unsigned head = audio->command_head.load(std::memory_order_acquire);
+	for (; tail != head; ++tail) {
+		oshu::audio_command *command = &audio->commands[tail % size];
+		switch (command->type) {
+		case oshu::PLAY_SAMPLE_COMMAND:
+			oshu::start_track(select_track(audio), command->sample, command->volume, 0);
+			break;
+		case oshu::PLAY_LOOP_COMMAND:
+			oshu::start_track(&audio->looping, command->sample, command->volume, 1);
+			break;
+		case oshu::STOP_LOOP_COMMAND:
+			oshu::stop_track(&audio->looping);
+			break;
+		}
+	}
+	audio->command_tail.store(tail, std::memory_order_release);
+}
+
+/**
+ * Fill SDL's audio buffer with the music, then mix the sound effects on top.
+ *
+ * The commands the game thread queued since the previous call are executed
+ * first.
  *
- * When frames are interleaved, a coarser memcpy does the trick.
+ * The music was decoded ahead by the stream's decoding thread, so this only
+ * copies and mixes samples, and never waits for ffmpeg.
  *
- * When the stream is finished, fill what remains of the buffer with silence,
- * because you never know what SDL might do with a left-over buffer. Most
- * likely, it would play the previous buffer over, and over again.
+ * When the stream is finished, or if the decoder is late, fill what remains of
+ * the buffer with silence, because you never know what SDL might do with a
+ * left-over buffer. Most likely, it would play the previous buffer over, and
+ * over again.
  */
 static void audio_callback(void *userdata, Uint8 *buffer, int len)
 {
@@ -59,11 +98,10 @@ static void audio_callback(void *userdata, Uint8 *buffer, int len)
 	int nb_samples = len / unit;
 	float *samples = (float*) buffer;
 
+	run_commands(audio);
+
 	int rc = oshu::read_stream(&audio->music, samples, nb_samples);
-	if (rc < 0) {
-		oshu_log_debug("failed reading samples from the audio stream");
-		return;
-	} else if (rc < nb_samples) {
+	if (rc < nb_samples) {
 		/* fill what remains with silence */
 		memset(buffer + rc * unit, 0, len - rc * unit);
 	}
@@ -73,7 +111,8 @@ static void audio_callback(void *userdata, Uint8 *buffer, int len)
 		oshu::mix_track(&audio->effects[i], samples, nb_samples);
 	oshu::mix_track(&audio->looping, samples, nb_samples);
 
-	clip(samples, nb_samples, audio->device_spec.channels);
+	/* Without clipping, some audio cards emit an awful noise. */
+	oshu::clip_samples(samples, nb_samples * audio->device_spec.channels);
 }
 
 /**
@@ -132,59 +171,45 @@ void oshu::close_audio(oshu::audio *audio)
 }
 
 /**
- * Pick a track for playing sound effects.
+ * Queue a command for the audio thread.
  *
- * If one track is inactive, pick it without hesitation. If all the tracks
- * are active, pick the one with the biggest cursor, because there's a good
- * chance it's about to end.
- *
- * Make sure you lock the audio device when calling this function, in order to
- * ensure predictable results.
+ * This is the producer side of #oshu::audio::commands.
  */
-static oshu::track *select_track(oshu::audio *audio)
+static void send_command(oshu::audio *audio, oshu::audio_command_type type, oshu::sample *sample, float volume)
 {
-	int max_cursor = 0;
-	oshu::track *best_track = &audio->effects[0];
-	int tracks = sizeof(audio->effects) / sizeof(*audio->effects);
-	for (int i = 0; i < tracks; ++i) {
-		oshu::track *c = &audio->effects[i];
-		if (c->sample == NULL) {
-			return c;
-		} else if (c->cursor > max_cursor) {
-			max_cursor = c->cursor;
-			best_track = c;
-		}
+	unsigned size = sizeof(audio->commands) / sizeof(*audio->commands);
+	unsigned head = audio->command_head.load(std::memory_order_relaxed);
+	if (head - audio->command_tail.load(std::memory_order_acquire) == size) {
+		oshu_log_warning("the audio command queue is full, dropping a command");
+		return;
 	}
-	return best_track;
+	oshu::audio_command *command = &audio->commands[head % size];
+	command->type = type;
+	command->sample = sample;
+	command->volume = volume;
+	audio->command_head.store(head + 1, std::memory_order_release);
 }
 
 void oshu::play_sample(oshu::audio *audio, oshu::sample *sample, float volume)
 {
-	SDL_LockAudioDevice(audio->device_id);
-	oshu::track *track = select_track(audio);
-	if (track->sample != NULL)
-		oshu_log_debug("all the effect tracks are taken, stealing one");
-	oshu::start_track(track, sample, volume, 0);
-	SDL_UnlockAudioDevice(audio->device_id);
+	send_command(audio, oshu::PLAY_SAMPLE_COMMAND, sample, volume);
 }
 
 void oshu::play_loop(oshu::audio *audio, oshu::sample *sample, float volume)
 {
-	SDL_LockAudioDevice(audio->device_id);
-	oshu::start_track(&audio->looping, sample, volume, 1);
-	SDL_UnlockAudioDevice(audio->device_id);
+	send_command(audio, oshu::PLAY_LOOP_COMMAND, sample, volume);
 }
 
 void oshu::stop_loop(oshu::audio *audio)
 {
-	SDL_LockAudioDevice(audio->device_id);
-	oshu::stop_track(&audio->looping);
-	SDL_UnlockAudioDevice(audio->device_id);
+	send_command(audio, oshu::STOP_LOOP_COMMAND, NULL, 0);
 }
 
 int oshu::seek_music(oshu::audio *audio, double target)
 {
 	SDL_LockAudioDevice(audio->device_id);
+	/* The callback is not running, so we may drop its pending commands. */
+	audio->command_tail.store(audio->command_head.load());
 	int rc = oshu::seek_stream(&audio->music, target);
 	oshu::stop_track(&audio->looping);
 	int tracks = sizeof(audio->effects) / sizeof(*audio->effects);
@@ -0,0 +1,327 @@
+/**
+ * \file audio/cache.cc
+ * \ingroup audio_stream
+ *
+ * \brief
+ * Decoded audio cache.
+ *
+ * See the internal header for a description of the format.
+ */
+
+#include "./cache.h"
+#include "audio/stream.h"
+#include "core/cache.h"
+#include "core/log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/** Work in stereo. */
+static const int channels = 2;
+
+/**
+ * Every cache file begins with these 8 bytes.
+ */
+static const char cache_magic[8] = {'o', 's', 'h', 'u', 'p', 'c', 'm', '\0'};
+
+/**
+ * Version of the cache format.
+ *
+ * Bump it whenever the header or the sample format change.
+ */
+static const uint32_t cache_version = 1;
+
+/**
+ * Leading structure of the cache file.
+ */
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	/** Number of channels of the samples, always 2. */
+	uint32_t channels;
+	/** Sample rate of the samples, in Hz. */
+	uint32_t sample_rate;
+	uint32_t reserved;
+	/** Number of samples per channel. */
+	uint64_t nb_samples;
+	/** See #oshu::stream::start_timestamp. */
+	double start_timestamp;
+	/** See #oshu::stream::duration. */
+	double duration;
+};
+
+/**
+ * Default size limit of the cache directory, in MiB, when
+ * `OSHU_AUDIO_CACHE_SIZE` is not set.
+ *
+ * That's about 50 minutes of music.
+ */
+static const long default_cache_size = 1024;
+
+/**
+ * The samples start right after the header, on a cache line boundary.
+ */
+static const size_t samples_offset = 64;
+
+static_assert(sizeof(cache_header) <= samples_offset, "the cache header overflows into the samples");
+
+/**
+ * Compute the 64-bit FNV-1a hash of the file at *path*.
+ *
+ * Return -1 if the file can't be read, which is the case for URLs.
+ */
+static int hash_file(const char *path, uint64_t *hash)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat s;
+	if (fstat(fd, &s) < 0 || !S_ISREG(s.st_mode)) {
+		close(fd);
+		return -1;
+	}
+	size_t size = s.st_size;
+	const unsigned char *data = NULL;
+	if (size > 0) {
+		void *region = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (region == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		madvise(region, size, MADV_SEQUENTIAL);
+		data = (const unsigned char*) region;
+	}
+	close(fd);
+	uint64_t h = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= data[i];
+		h *= 0x100000001b3;
+	}
+	if (data)
+		munmap((void*) data, size);
+	*hash = h;
+	return 0;
+}
+
+/**
+ * Find the path of the cache file for the audio file at *path*.
+ *
+ * \return 0 on success, -1 if the file can't be hashed or there's no cache
+ * directory.
+ */
+static int cache_path(const char *path, std::string *cache)
+{
+	uint64_t hash;
+	std::string directory = oshu::cache_directory("audio");
+	if (directory.empty() || hash_file(path, &hash) < 0)
+		return -1;
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.pcm", (unsigned long long) hash);
+	*cache = directory + name;
+	return 0;
+}
+
+/**
+ * Read the size limit of the cache from the `OSHU_AUDIO_CACHE_SIZE`
+ * environment variable, and return it in bytes.
+ */
+static double cache_size()
+{
+	long mib = default_cache_size;
+	const char *value = getenv("OSHU_AUDIO_CACHE_SIZE");
+	if (value && *value) {
+		char *end;
+		long v = strtol(value, &end, 10);
+		if (*end != '\0' || v < 0)
+			oshu_log_warning("invalid OSHU_AUDIO_CACHE_SIZE value: %s", value);
+		else
+			mib = v;
+	}
+	return mib * 1024. * 1024.;
+}
+
+struct cache_file {
+	std::string path;
+	struct timespec mtime;
+	off_t size;
+};
+
+/**
+ * Delete the least recently used cache files until the directory fits in
+ * *limit* bytes, sparing the file at *keep*.
+ *
+ * The modification time tells when a file was last used, because
+ * #oshu::load_stream_cache updates it. The access time would be more natural,
+ * but most systems mount their file systems with relatime or noatime.
+ *
+ * Only the complete cache files are considered, as the temporary ones may be
+ * being written by another process.
+ */
+static void trim_cache(const std::string &directory, double limit, const std::string &keep)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (!dir)
+		return;
+	std::vector<struct cache_file> files;
+	double total = 0;
+	while (struct dirent *entry = readdir(dir)) {
+		size_t length = strlen(entry->d_name);
+		if (length < 4 || strcmp(entry->d_name + length - 4, ".pcm"))
+			continue;
+		struct cache_file file;
+		file.path = directory + "/" + entry->d_name;
+		struct stat s;
+		if (stat(file.path.c_str(), &s) < 0 || !S_ISREG(s.st_mode))
+			continue;
+		file.mtime = s.st_mtim;
+		file.size = s.st_size;
+		total += file.size;
+		files.push_back(file);
+	}
+	closedir(dir);
+	std::sort(files.begin(), files.end(), [](const struct cache_file &a, const struct cache_file &b) {
+		if (a.mtime.tv_sec != b.mtime.tv_sec)
+			return a.mtime.tv_sec < b.mtime.tv_sec;
+		return a.mtime.tv_nsec < b.mtime.tv_nsec;
+	});
+	for (const struct cache_file &file : files) {
+		if (total <= limit)
+			break;
+		if (file.path == keep)
+			continue;
+		if (unlink(file.path.c_str()) == 0) {
+			oshu_log_debug("evicted the audio cache %s", file.path.c_str());
+			total -= file.size;
+		}
+	}
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t rc = write(fd, data, size);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0)
+			return -1;
+		data += rc;
+		size -= rc;
+	}
+	return 0;
+}
+
+void oshu::save_stream_cache(const char *path, oshu::stream *stream)
+{
+	double limit = cache_size();
+	size_t size = samples_offset + (size_t) stream->nb_samples * channels * sizeof(float);
+	if (size > limit)
+		return;
+	std::string final_path;
+	if (cache_path(path, &final_path) < 0)
+		return;
+	std::string directory = oshu::cache_directory("audio");
+	if (oshu::make_directories(directory) < 0) {
+		oshu_log_warning("could not create the audio cache directory: %s", strerror(errno));
+		return;
+	}
+
+	char header[samples_offset];
+	memset(header, 0, sizeof(header));
+	struct cache_header *h = (struct cache_header*) header;
+	memcpy(h->magic, cache_magic, sizeof(h->magic));
+	h->version = cache_version;
+	h->channels = channels;
+	h->sample_rate = stream->sample_rate;
+	h->nb_samples = stream->nb_samples;
+	h->start_timestamp = stream->start_timestamp;
+	h->duration = stream->duration;
+
+	std::string temporary_path = final_path + ".XXXXXX";
+	int fd = mkstemp(&temporary_path[0]);
+	if (fd < 0) {
+		oshu_log_warning("could not create the audio cache: %s", strerror(errno));
+		return;
+	}
+	int rc = write_all(fd, header, sizeof(header));
+	if (rc == 0)
+		rc = write_all(fd, (const char*) stream->samples, (size_t) stream->nb_samples * channels * sizeof(float));
+	if (close(fd) < 0)
+		rc = -1;
+	if (rc < 0 || rename(temporary_path.c_str(), final_path.c_str()) < 0) {
+		oshu_log_warning("could not write the audio cache: %s", strerror(errno));
+		unlink(temporary_path.c_str());
+		return;
+	}
+	oshu_log_debug("saved the audio cache %s", final_path.c_str());
+	trim_cache(directory, limit, final_path);
+}
+
+static int check_header(const struct cache_header *header, size_t size)
+{
+	if (memcmp(header->magic, cache_magic, sizeof(header->magic)))
+		return -1;
+	if (header->version != cache_version || header->channels != channels)
+		return -1;
+	if (header->sample_rate == 0 || header->nb_samples == 0 || header->nb_samples > INT32_MAX)
+		return -1;
+	if (size != samples_offset + header->nb_samples * channels * sizeof(float))
+		return -1;
+	return 0;
+}
+
+int oshu::load_stream_cache(const char *path, double budget, oshu::stream *stream)
+{
+	std::string cache;
+	if (cache_size() == 0 || cache_path(path, &cache) < 0)
+		return -1;
+	int fd = open(cache.c_str(), O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat s;
+	if (fstat(fd, &s) < 0 || (size_t) s.st_size < samples_offset) {
+		close(fd);
+		return -1;
+	}
+	if (s.st_size - samples_offset > budget) {
+		oshu_log_debug("the audio cache %s exceeds the predecoding budget", cache.c_str());
+		close(fd);
+		return -1;
+	}
+	size_t size = s.st_size;
+	void *region = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	/* mark it as recently used, see trim_cache */
+	futimens(fd, NULL);
+	close(fd);
+	if (region == MAP_FAILED) {
+		oshu_log_warning("could not map the audio cache %s: %s", cache.c_str(), strerror(errno));
+		return -1;
+	}
+	const struct cache_header *header = (const struct cache_header*) region;
+	if (check_header(header, size) < 0) {
+		oshu_log_debug("ignoring the invalid audio cache %s", cache.c_str());
+		munmap(region, size);
+		return -1;
+	}
+	stream->mapping = (char*) region;
+	stream->mapping_size = size;
+	stream->samples = (float*) (stream->mapping + samples_offset);
+	stream->nb_samples = header->nb_samples;
+	stream->sample_rate = header->sample_rate;
+	stream->start_timestamp = header->start_timestamp;
+	stream->duration = header->duration;
+	stream->current_timestamp = stream->start_timestamp;
+	oshu_log_debug("loaded the decoded audio from its cache %s", cache.c_str());
+	return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * \file audio/cache.h
+ * \ingroup audio_stream
+ *
+ * \brief
+ * Internal header for the decoded audio cache.
+ *
+ * Decoding a whole track takes a noticeable time at startup, and it is done
+ * again every time the same beatmap is played. Once a stream was predecoded,
+ * its samples are saved to the cache directory, and mapped in memory instead
+ * of decoded the next time.
+ *
+ * The cache directory is `$XDG_CACHE_HOME/oshu/audio`, or
+ * `$HOME/.cache/oshu/audio` when `XDG_CACHE_HOME` is not set. Each file is
+ * named after the 64-bit FNV-1a hash of the content of the audio file, so that
+ * the difficulties of a beatmap set, which share their audio file, share their
+ * cache too, and so that a modified audio file is never mistaken for the
+ * original.
+ *
+ * A cache file is a header, recording among others the sample rate, followed
+ * by the packed stereo float samples, exactly as #oshu::stream::samples
+ * expects them. The header records a format version, which must be bumped
+ * whenever the layout changes.
+ *
+ * The directory is bounded by `OSHU_AUDIO_CACHE_SIZE`. Every time a file is
+ * saved, the least recently used ones are deleted until the directory fits
+ * again.
+ *
+ * The samples are read from the audio callback, where a page fault could
+ * mean a disk read, so the whole file is loaded into memory when it is
+ * mapped. The pages still belong to the page cache, so an unchanged track
+ * played again loads without touching the disk.
+ */
+
+#pragma once
+
+namespace oshu {
+
+struct stream;
+
+/**
+ * Map the cached samples of the audio file at *path* into the stream.
+ *
+ * On success, the stream is set up like a predecoded stream, with
+ * #oshu::stream::samples pointing inside #oshu::stream::mapping, and its
+ * ffmpeg contexts left null.
+ *
+ * The mapped samples count against the predecoding budget like the decoded
+ * ones, so a cache whose samples take more than *budget* bytes is ignored
+ * before it is mapped.
+ *
+ * Return -1 if the cache is missing, invalid, or too large. In that case, the
+ * stream is left untouched.
+ */
+int load_stream_cache(const char *path, double budget, oshu::stream *stream);
+
+/**
+ * Save the samples of a predecoded stream to the cache.
+ *
+ * The file is written under a unique temporary name, then renamed, so that a
+ * concurrent reader never sees a partial cache.
+ *
+ * Nothing is saved when the samples alone exceed the size limit of the
+ * cache. Otherwise, the least recently used files are evicted once the new
+ * one is written.
+ *
+ * Failing to write the cache is not an error for the caller, as the stream
+ * can always be decoded again, so this function only logs a warning.
+ */
+void save_stream_cache(const char *path, oshu::stream *stream);
+
+}
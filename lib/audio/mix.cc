@@ -0,0 +1,167 @@
+/**
+ * \file audio/mix.cc
+ * \ingroup audio_mix
+ */
+
+#include "audio/mix.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OSHU_X86
+#include <immintrin.h>
+#endif
+
+static void mix_scalar(float *samples, const float *input, float volume, int count)
+{
+	for (int i = 0; i < count; ++i)
+		samples[i] += volume * input[i];
+}
+
+static void clip_scalar(float *samples, int count)
+{
+	for (int i = 0; i < count; ++i) {
+		if (samples[i] > 1.f)
+			samples[i] = 1.f;
+		else if (samples[i] < -1.f)
+			samples[i] = -1.f;
+	}
+}
+
+#ifdef OSHU_X86
+
+static void mix_sse2(float *samples, const float *input, float volume, int count)
+{
+	__m128 v = _mm_set1_ps(volume);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 s = _mm_loadu_ps(samples + i);
+		__m128 in = _mm_loadu_ps(input + i);
+		_mm_storeu_ps(samples + i, _mm_add_ps(s, _mm_mul_ps(v, in)));
+	}
+	mix_scalar(samples + i, input + i, volume, count - i);
+}
+
+static void clip_sse2(float *samples, int count)
+{
+	__m128 low = _mm_set1_ps(-1.f);
+	__m128 high = _mm_set1_ps(1.f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 s = _mm_loadu_ps(samples + i);
+		_mm_storeu_ps(samples + i, _mm_min_ps(_mm_max_ps(s, low), high));
+	}
+	clip_scalar(samples + i, count - i);
+}
+
+/**
+ * Unlike the SSE2 version, the loop is unrolled twice, because a single FMA
+ * chain doesn't keep the two load ports busy.
+ */
+__attribute__((target("avx2,fma")))
+static void mix_avx2(float *samples, const float *input, float volume, int count)
+{
+	__m256 v = _mm256_set1_ps(volume);
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256 s0 = _mm256_loadu_ps(samples + i);
+		__m256 s1 = _mm256_loadu_ps(samples + i + 8);
+		s0 = _mm256_fmadd_ps(v, _mm256_loadu_ps(input + i), s0);
+		s1 = _mm256_fmadd_ps(v, _mm256_loadu_ps(input + i + 8), s1);
+		_mm256_storeu_ps(samples + i, s0);
+		_mm256_storeu_ps(samples + i + 8, s1);
+	}
+	mix_sse2(samples + i, input + i, volume, count - i);
+}
+
+__attribute__((target("avx2")))
+static void clip_avx2(float *samples, int count)
+{
+	__m256 low = _mm256_set1_ps(-1.f);
+	__m256 high = _mm256_set1_ps(1.f);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 s = _mm256_loadu_ps(samples + i);
+		_mm256_storeu_ps(samples + i, _mm256_min_ps(_mm256_max_ps(s, low), high));
+	}
+	clip_sse2(samples + i, count - i);
+}
+
+#endif
+
+struct kernels {
+	void (*mix)(float *samples, const float *input, float volume, int count);
+	void (*clip)(float *samples, int count);
+};
+
+/**
+ * Indexed by #oshu::mix_kernel. A null entry means the kernel wasn't built.
+ */
+static const struct kernels all_kernels[] = {
+	{mix_scalar, clip_scalar},
+#ifdef OSHU_X86
+	{mix_sse2, clip_sse2},
+	{mix_avx2, clip_avx2},
+#else
+	{nullptr, nullptr},
+	{nullptr, nullptr},
+#endif
+};
+
+/**
+ * Check whether the processor supports a kernel.
+ *
+ * It may be called from a static initializer, before libgcc initialized its
+ * processor model, hence the explicit *__builtin_cpu_init*.
+ */
+static bool supported(oshu::mix_kernel kernel)
+{
+#ifdef OSHU_X86
+	__builtin_cpu_init();
+#endif
+	switch (kernel) {
+	case oshu::SCALAR_KERNEL:
+		return true;
+#ifdef OSHU_X86
+	case oshu::SSE2_KERNEL:
+		return __builtin_cpu_supports("sse2");
+	case oshu::AVX2_KERNEL:
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	default:
+		return false;
+	}
+}
+
+static oshu::mix_kernel best_kernel()
+{
+	if (supported(oshu::AVX2_KERNEL))
+		return oshu::AVX2_KERNEL;
+	else if (supported(oshu::SSE2_KERNEL))
+		return oshu::SSE2_KERNEL;
+	else
+		return oshu::SCALAR_KERNEL;
+}
+
+static oshu::mix_kernel current_kernel = best_kernel();
+
+void oshu::mix_samples(float *samples, const float *input, float volume, int count)
+{
+	all_kernels[current_kernel].mix(samples, input, volume, count);
+}
+
+void oshu::clip_samples(float *samples, int count)
+{
+	all_kernels[current_kernel].clip(samples, count);
+}
+
+oshu::mix_kernel oshu::get_mix_kernel()
+{
+	return current_kernel;
+}
+
+int oshu::set_mix_kernel(oshu::mix_kernel kernel)
+{
+	if (!supported(kernel))
+		return -1;
+	current_kernel = kernel;
+	return 0;
+}
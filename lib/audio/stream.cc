@@ -4,6 +4,7 @@
  */
 
 #include "audio/stream.h"
+#include "./cache.h"
 #include "core/log.h"
 
 extern "C" {
@@ -13,10 +14,115 @@ extern "C" {
 }
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 /** Work in stereo. */
 static const int channels = 2;
 
+/**
+ * Number of samples per channel in a chunk of the ring buffer.
+ *
+ * That's about 23 milliseconds at 44.1 kHz, which keeps the timestamp
+ * interpolation within a chunk short.
+ */
+static const int chunk_size = 1024;
+
+/**
+ * Number of chunks in the ring buffer.
+ *
+ * 16 chunks are about 370 milliseconds of audio at 44.1 kHz, or 8 calls of
+ * the audio callback, which is plenty to absorb a slow page.
+ */
+static const unsigned chunk_count = 16;
+
+/**
+ * Number of chunks #oshu::seek_stream decodes before returning.
+ */
+static const int seek_chunks = 4;
+
+/**
+ * Default predecoding budget, in MiB, when `OSHU_PREDECODE_BUDGET` is not set.
+ */
+static const long default_predecode_budget = 128;
+
+/**
+ * How long the decoding thread sleeps when the ring is full.
+ *
+ * The reader never signals the decoding thread, as that would mean calling
+ * into the system from the audio callback, so the thread polls instead. A
+ * poll every 10 milliseconds keeps the ring nearly full.
+ */
+static const std::chrono::milliseconds poll_interval(10);
+
+/**
+ * A chunk of decoded samples in the ring.
+ */
+struct pcm_chunk {
+	/**
+	 * Timestamp of the first sample of the chunk, in seconds.
+	 */
+	double timestamp;
+	/**
+	 * Number of samples per channel in the chunk.
+	 *
+	 * Only the last chunk of the stream may be smaller than #chunk_size.
+	 */
+	int size;
+	float samples[chunk_size * channels];
+};
+
+/**
+ * A single-producer single-consumer ring of decoded chunks.
+ *
+ * The decoding thread writes chunks at #head, and #oshu::read_stream reads them
+ * from #tail. The indices grow forever and are reduced modulo #chunk_count,
+ * so that the ring is empty when they're equal, and full when they're
+ * #chunk_count apart.
+ *
+ * Each side only writes its own index. A chunk is published by storing the
+ * head with the release order, and released by storing the tail with the
+ * release order, so the loads on the other side use the acquire order.
+ */
+struct oshu::stream_buffer {
+	pcm_chunk chunks[chunk_count];
+	std::atomic<unsigned> head;
+	std::atomic<unsigned> tail;
+	/**
+	 * Number of samples per channel already read from the chunk at #tail.
+	 *
+	 * It belongs to the reader.
+	 */
+	int offset;
+	/**
+	 * Set by the decoding thread after it published the last chunk of the
+	 * stream.
+	 */
+	std::atomic<bool> complete;
+	/**
+	 * Set by #oshu::close_stream to stop the decoding thread.
+	 */
+	std::atomic<bool> stop;
+	/**
+	 * Protect the decoding state of the stream, which the decoding thread
+	 * and #oshu::seek_stream share. The reader never takes it.
+	 */
+	std::mutex mutex;
+	/**
+	 * Wake the decoding thread up before its #poll_interval, when the ring
+	 * was emptied by a seek or when the stream is closed.
+	 */
+	std::condition_variable wakeup;
+	std::thread thread;
+};
+
 /**
  * Spew an error message according to the return value of a call to one of
  * ffmpeg's functions.
@@ -72,7 +178,7 @@ static int next_page(oshu::stream *stream)
  * Read the next frame from the stream into #oshu::stream::frame.
  *
  * When the end of file is reached, or when an error occurs, set
- * #oshu::stream::finished to true.
+ * #oshu::stream::eof to true.
  */
 static int next_frame(oshu::stream *stream)
 {
@@ -81,7 +187,7 @@ static int next_frame(oshu::stream *stream)
 		if (rc == 0) {
 			int64_t ts = stream->frame->best_effort_timestamp;
 			if (ts > 0)
-				stream->current_timestamp = stream->time_base * ts;
+				stream->decoded_timestamp = stream->time_base * ts;
 			stream->sample_index = 0;
 			return 0;
 		} else if (rc == AVERROR(EAGAIN)) {
@@ -91,12 +197,12 @@ static int next_frame(oshu::stream *stream)
 			}
 		} else if (rc == AVERROR_EOF) {
 			oshu_log_debug("reached the last frame");
-			stream->finished = 1;
+			stream->eof = 1;
 			return 0;
 		} else {
 			oshu_log_error("frame decoding failed");
 			log_av_error(rc);
-			stream->finished = 1;
+			stream->eof = 1;
 			return -1;
 		}
 	}
@@ -134,10 +240,16 @@ static int convert_frame(struct SwrContext *converter, AVFrame *frame, int index
 	return rc;
 }
 
-int oshu::read_stream(oshu::stream *stream, float *samples, int nb_samples)
+/**
+ * Decode *nb_samples* samples per channel into *samples*.
+ *
+ * Return the number of samples per channel decoded, which is less than
+ * *nb_samples* only at the end of the stream, or -1 on error.
+ */
+static int decode_samples(oshu::stream *stream, float *samples, int nb_samples)
 {
 	int left = nb_samples;
-	while (left > 0 && !stream->finished) {
+	while (left > 0 && !stream->eof) {
 		if (stream->sample_index >= stream->frame->nb_samples) {
 			if (next_frame(stream) < 0)
 				return -1;
@@ -148,12 +260,104 @@ int oshu::read_stream(oshu::stream *stream, float *samples, int nb_samples)
 			return -1;
 		left -= rc;
 		stream->sample_index += rc;
-		stream->current_timestamp += (double) rc / stream->decoder->sample_rate;
+		stream->decoded_timestamp += (double) rc / stream->decoder->sample_rate;
 		samples += rc * channels;
 	}
 	return nb_samples - left;
 }
 
+/**
+ * Decode the next chunk of the stream into the ring, if there's room for it.
+ *
+ * An error ends the stream, as there's no one to report it to in the decoding
+ * thread.
+ *
+ * The caller must hold the buffer's mutex.
+ *
+ * \return 1 if a chunk was decoded, 0 if the ring is full or the stream is
+ * over.
+ */
+static int fill_chunk(oshu::stream *stream)
+{
+	oshu::stream_buffer *buffer = stream->buffer;
+	unsigned head = buffer->head.load(std::memory_order_relaxed);
+	if (stream->eof || head - buffer->tail.load(std::memory_order_acquire) == chunk_count)
+		return 0;
+	pcm_chunk *c = &buffer->chunks[head % chunk_count];
+	c->timestamp = stream->decoded_timestamp;
+	int rc = decode_samples(stream, c->samples, chunk_size);
+	if (rc < 0) {
+		oshu_log_warning("abrupt end of stream");
+		stream->eof = 1;
+		rc = 0;
+	}
+	c->size = rc;
+	if (rc > 0)
+		buffer->head.store(head + 1, std::memory_order_release);
+	if (stream->eof)
+		buffer->complete.store(true, std::memory_order_release);
+	return 1;
+}
+
+/**
+ * Main loop of the decoding thread: keep the ring full until the stream is
+ * closed.
+ */
+static void decode(oshu::stream *stream)
+{
+	oshu::stream_buffer *buffer = stream->buffer;
+	std::unique_lock<std::mutex> lock(buffer->mutex);
+	while (!buffer->stop.load(std::memory_order_relaxed)) {
+		if (!fill_chunk(stream))
+			buffer->wakeup.wait_for(lock, poll_interval);
+	}
+}
+
+/**
+ * Copy the samples of a predecoded stream.
+ */
+static int read_samples(oshu::stream *stream, float *samples, int nb_samples)
+{
+	int left = stream->nb_samples - stream->cursor;
+	int consume = left < nb_samples ? left : nb_samples;
+	memcpy(samples, stream->samples + stream->cursor * channels, consume * channels * sizeof(*samples));
+	stream->cursor += consume;
+	stream->current_timestamp = stream->start_timestamp + (double) stream->cursor / stream->sample_rate;
+	if (stream->cursor == stream->nb_samples)
+		stream->finished = 1;
+	return consume;
+}
+
+int oshu::read_stream(oshu::stream *stream, float *samples, int nb_samples)
+{
+	if (stream->samples)
+		return read_samples(stream, samples, nb_samples);
+	oshu::stream_buffer *buffer = stream->buffer;
+	int left = nb_samples;
+	while (left > 0) {
+		unsigned tail = buffer->tail.load(std::memory_order_relaxed);
+		if (tail == buffer->head.load(std::memory_order_acquire)) {
+			/* The last chunk may be published right before complete is set. */
+			if (buffer->complete.load(std::memory_order_acquire) && tail == buffer->head.load(std::memory_order_acquire))
+				stream->finished = 1;
+			break;
+		}
+		pcm_chunk *c = &buffer->chunks[tail % chunk_count];
+		int available = c->size - buffer->offset;
+		int consume = available < left ? available : left;
+		memcpy(samples, c->samples + buffer->offset * channels, consume * channels * sizeof(*samples));
+		buffer->offset += consume;
+		stream->current_timestamp = c->timestamp + (double) buffer->offset / stream->sample_rate;
+		samples += consume * channels;
+		left -= consume;
+		if (buffer->offset == c->size) {
+			buffer->offset = 0;
+			buffer->tail.store(tail + 1, std::memory_order_release);
+		}
+	}
+	return nb_samples - left;
+}
+
 /**
  * Log some helpful information about the decoded audio stream.
  * Meant for debugging more than anything else.
@@ -278,6 +482,88 @@ static int open_converter(oshu::stream *stream)
 	return 0;
 }
 
+/**
+ * Read the predecoding budget from the `OSHU_PREDECODE_BUDGET` environment
+ * variable, and return it in bytes.
+ */
+static double predecode_budget()
+{
+	long mib = default_predecode_budget;
+	const char *value = getenv("OSHU_PREDECODE_BUDGET");
+	if (value && *value) {
+		char *end;
+		long v = strtol(value, &end, 10);
+		if (*end != '\0' || v < 0)
+			oshu_log_warning("invalid OSHU_PREDECODE_BUDGET value: %s", value);
+		else
+			mib = v;
+	}
+	return mib * 1024. * 1024.;
+}
+
+/**
+ * Decode the whole stream into #oshu::stream::samples, if it fits in the
+ * predecoding *budget*, in bytes.
+ *
+ * The size of the buffer is estimated from the duration of the stream, which
+ * is only an estimation for some formats, so the buffer grows if the stream
+ * turns out longer.
+ *
+ * \return 1 if the stream was predecoded, 0 if it doesn't fit in the budget,
+ * and -1 on error.
+ */
+static int predecode(oshu::stream *stream, double budget)
+{
+	double size = stream->duration * stream->sample_rate * channels * sizeof(float);
+	if (!(stream->duration > 0) || size > budget)
+		return 0;
+	int capacity = stream->duration * stream->sample_rate + chunk_size;
+	stream->samples = (float*) malloc(capacity * channels * sizeof(float));
+	if (stream->samples == NULL) {
+		oshu_log_warning("could not allocate the predecoded stream");
+		return 0;
+	}
+	stream->start_timestamp = stream->decoded_timestamp;
+	while (!stream->eof) {
+		if (capacity - stream->nb_samples < chunk_size) {
+			capacity *= 2;
+			float *samples = (float*) realloc(stream->samples, capacity * channels * sizeof(float));
+			if (samples == NULL) {
+				oshu_log_error("could not grow the predecoded stream");
+				return -1;
+			}
+			stream->samples = samples;
+		}
+		int rc = decode_samples(stream, stream->samples + stream->nb_samples * channels, chunk_size);
+		if (rc < 0)
+			return -1;
+		stream->nb_samples += rc;
+	}
+	stream->current_timestamp = stream->start_timestamp;
+	oshu_log_debug("predecoded %d samples", stream->nb_samples);
+	return 1;
+}
+
+/**
+ * Fill the ring buffer, then start the decoding thread.
+ *
+ * The first chunks are decoded in the calling thread, so that the audio
+ * callback finds samples to play as soon as the device is started.
+ */
+static void start_decoding(oshu::stream *stream)
+{
+	oshu::stream_buffer *buffer = new oshu::stream_buffer;
+	buffer->head = 0;
+	buffer->tail = 0;
+	buffer->offset = 0;
+	buffer->complete = false;
+	buffer->stop = false;
+	stream->buffer = buffer;
+	stream->current_timestamp = stream->decoded_timestamp;
+	while (fill_chunk(stream));
+	buffer->thread = std::thread(decode, stream);
+}
+
 int oshu::open_stream(const char *url, oshu::stream *stream)
 {
 	/*
@@ -289,6 +575,11 @@ int oshu::open_stream(const char *url, oshu::stream *stream)
 	av_register_all();
 	#endif
 
+	int rc;
+	double budget = predecode_budget();
+	/* hashing the file to find its cache is wasted work without a budget */
+	if (budget > 0 && oshu::load_stream_cache(url, budget, stream) == 0)
+		return 0;
 	if (open_demuxer(url, stream) < 0)
 		goto fail;
 	if (open_decoder(stream) < 0)
@@ -299,6 +590,13 @@ int oshu::open_stream(const char *url, oshu::stream *stream)
 		goto fail;
 	if (next_frame(stream) < 0)
 		goto fail;
+	rc = predecode(stream, budget);
+	if (rc < 0)
+		goto fail;
+	else if (rc == 0)
+		start_decoding(stream);
+	else
+		oshu::save_stream_cache(url, stream);
 	return 0;
 fail:
 	oshu::close_stream(stream);
@@ -307,6 +605,13 @@ fail:
 
 void oshu::close_stream(oshu::stream *stream)
 {
+	if (stream->buffer) {
+		stream->buffer->stop = true;
+		stream->buffer->wakeup.notify_one();
+		stream->buffer->thread.join();
+		delete stream->buffer;
+		stream->buffer = nullptr;
+	}
 	/* the av routines set the pointers to NULL */
 	if (stream->frame)
 		av_frame_free(&stream->frame);
@@ -316,6 +621,13 @@ void oshu::close_stream(oshu::stream *stream)
 		avformat_close_input(&stream->demuxer);
 	if (stream->converter)
 		swr_free(&stream->converter);
+	if (stream->mapping) {
+		munmap(stream->mapping, stream->mapping_size);
+		stream->mapping = NULL;
+	} else if (stream->samples) {
+		free(stream->samples);
+	}
+	stream->samples = NULL;
 }
 
 int oshu::seek_stream(oshu::stream *stream, double target)
@@ -326,19 +638,37 @@ int oshu::seek_stream(oshu::stream *stream, double target)
 		oshu_log_warning("cannot seek past the end of the stream");
 		return -1;
 	}
+	if (stream->samples) {
+		int cursor = (target - stream->start_timestamp) * stream->sample_rate;
+		stream->cursor = cursor < 0 ? 0 : cursor < stream->nb_samples ? cursor : stream->nb_samples;
+		stream->current_timestamp = stream->start_timestamp + (double) stream->cursor / stream->sample_rate;
+		stream->finished = stream->cursor == stream->nb_samples;
+		return 0;
+	}
+	oshu::stream_buffer *buffer = stream->buffer;
+	std::lock_guard<std::mutex> lock(buffer->mutex);
 	int rc = av_seek_frame(
 		stream->demuxer,
 		stream->stream->index,
 		target / stream->time_base,
-		target < stream->current_timestamp ? AVSEEK_FLAG_BACKWARD : 0
+		target < stream->decoded_timestamp ? AVSEEK_FLAG_BACKWARD : 0
 	);
 	if (rc < 0) {
 		log_av_error(rc);
 		return -1;
 	}
-	stream->current_timestamp = target;
+	stream->decoded_timestamp = target;
+	stream->eof = 0;
 	/* Flush the buffers. */
 	next_page(stream);
 	next_frame(stream);
+	/* Drop the samples decoded from the previous position. */
+	buffer->tail = buffer->head.load();
+	buffer->offset = 0;
+	buffer->complete = false;
+	stream->current_timestamp = stream->decoded_timestamp;
+	stream->finished = 0;
+	for (int i = 0; i < seek_chunks && fill_chunk(stream); ++i);
+	buffer->wakeup.notify_one();
 	return 0;
 }
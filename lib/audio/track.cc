@@ -3,11 +3,11 @@
  * \ingroup audio_track
  */
 
+#include "audio/mix.h"
 #include "audio/sample.h"
 #include "audio/track.h"
 
 #include <assert.h>
-#include <math.h>
 #include <stdlib.h>
 
 /** Work in stereo. */
@@ -44,8 +44,7 @@ int oshu::mix_track(oshu::track *track, float *samples, int nb_samples)
 		}
 		int consume = left < wanted ? left : wanted;
 		float *input = track->sample->samples + track->cursor * channels;
-		for (int i = 0; i < consume * channels; i++)
-			samples[i] = fmaf(input[i], track->volume, samples[i]);
+		oshu::mix_samples(samples, input, track->volume, consume * channels);
 		track->cursor += consume;
 		samples += consume * channels;
 		wanted -= consume;
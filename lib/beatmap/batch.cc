@@ -0,0 +1,87 @@
+/**
+ * \file beatmap/batch.cc
+ * \ingroup beatmap
+ *
+ * \brief
+ * Load many beatmaps concurrently.
+ */
+
+#include "beatmap/beatmap.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+
+/**
+ * Shared state of the worker threads.
+ *
+ * Instead of splitting the beatmaps evenly between the threads beforehand,
+ * every thread picks the next beatmap to load from #next. Beatmaps vary a lot
+ * in size, so this keeps all the threads busy until the very end.
+ */
+struct batch {
+	const char *const *paths;
+	int count;
+	oshu::beatmap *beatmaps;
+	int *status;
+	int (*load)(const char*, oshu::beatmap*);
+	std::atomic<int> next;
+	std::atomic<int> loaded;
+};
+
+static void work(struct batch *batch)
+{
+	for (;;) {
+		int i = batch->next++;
+		if (i >= batch->count)
+			break;
+		batch->status[i] = batch->load(batch->paths[i], &batch->beatmaps[i]);
+		if (batch->status[i] < 0)
+			memset((void*) &batch->beatmaps[i], 0, sizeof(batch->beatmaps[i]));
+		else
+			batch->loaded++;
+	}
+}
+
+static int load_batch(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status, int (*load)(const char*, oshu::beatmap*))
+{
+	struct batch batch;
+	batch.paths = paths;
+	batch.count = count;
+	batch.beatmaps = beatmaps;
+	batch.status = status;
+	batch.load = load;
+	batch.next = 0;
+	batch.loaded = 0;
+
+	int thread_count = std::thread::hardware_concurrency();
+	if (thread_count < 1)
+		thread_count = 1;
+	if (thread_count > count)
+		thread_count = count;
+	/* The calling thread works too. */
+	std::vector<std::thread> threads;
+	for (int i = 1; i < thread_count; ++i)
+		threads.emplace_back(work, &batch);
+	work(&batch);
+	for (std::thread &thread : threads)
+		thread.join();
+	return batch.loaded;
+}
+
+int oshu::load_beatmaps(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status)
+{
+	return load_batch(paths, count, beatmaps, status, oshu::load_beatmap);
+}
+
+int oshu::load_beatmaps_headers(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status)
+{
+	return load_batch(paths, count, beatmaps, status, oshu::load_beatmap_headers);
+}
+
+int oshu::scan_beatmaps(const char *const *paths, int count, oshu::beatmap *beatmaps, int *status)
+{
+	return load_batch(paths, count, beatmaps, status, oshu::scan_beatmap);
+}
@@ -0,0 +1,641 @@
+/**
+ * \file beatmap/cache.cc
+ * \ingroup beatmap
+ *
+ * \brief
+ * Compiled beatmap cache.
+ *
+ * See the internal header for a description of the format.
+ */
+
+#include "./cache.h"
+#include "core/cache.h"
+#include "core/log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Every cache file begins with these 8 bytes.
+ */
+static const char cache_magic[8] = {'o', 's', 'h', 'u', 'm', 'a', 'p', '\0'};
+
+/**
+ * Version of the cache format.
+ *
+ * Bump it whenever the structures stored in the cache, or the way they're
+ * computed by the parser, change.
+ */
+static const uint32_t cache_version = 10;
+
+/**
+ * Leading structure of the cache file.
+ */
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	/** `sizeof(oshu::beatmap)` for the build that wrote the cache. */
+	uint32_t beatmap_size;
+	/** `sizeof(oshu::hit)` for the build that wrote the cache. */
+	uint32_t hit_size;
+	/** Number of timing points. */
+	uint32_t timing_point_count;
+	/** Number of hit objects, including the unreachable ones. */
+	uint32_t hit_count;
+	uint32_t reserved;
+	/** Modification time of the beatmap file, in nanoseconds. */
+	int64_t source_mtime;
+	/** Size of the beatmap file. */
+	uint64_t source_size;
+	/** Size of the whole cache file, header included. */
+	uint64_t size;
+};
+
+/**
+ * Every object in the cache is aligned like *malloc* would.
+ */
+static const size_t alignment = alignof(max_align_t);
+
+static size_t align(size_t size)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * The #oshu::beatmap structure directly follows the header.
+ */
+static const size_t beatmap_offset = align(sizeof(cache_header));
+
+/**
+ * Find the path of the cache file for the beatmap file at *path*.
+ *
+ * The cache file is named after the 64-bit FNV-1a hash of the real path of
+ * the beatmap, so that the same beatmap opened through a relative path or a
+ * symbolic link finds its cache.
+ *
+ * \return 0 on success, -1 if the beatmap doesn't exist or there's no cache
+ * directory.
+ */
+static int cache_path(const char *path, std::string *cache)
+{
+	std::string directory = oshu::cache_directory("beatmaps");
+	if (directory.empty())
+		return -1;
+	char *real = realpath(path, NULL);
+	if (!real)
+		return -1;
+	uint64_t hash = 0xcbf29ce484222325;
+	for (const char *c = real; *c; ++c) {
+		hash ^= (unsigned char) *c;
+		hash *= 0x100000001b3;
+	}
+	free(real);
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.cache", (unsigned long long) hash);
+	*cache = directory + name;
+	return 0;
+}
+
+static int64_t mtime(const struct stat *source)
+{
+	return (int64_t) source->st_mtim.tv_sec * 1000000000 + source->st_mtim.tv_nsec;
+}
+
+/**
+ * Size of the indices array of a Bézier path, including the slot reserved
+ * for its extension.
+ *
+ * \sa oshu::bezier::extended
+ */
+static size_t index_count(const oshu::bezier *bezier)
+{
+	return bezier->segment_count + (bezier->extended ? 1 : 2);
+}
+
+/**
+ * Size of the control points array of a Bézier path, including the room
+ * reserved for its extension.
+ *
+ * The indices must be valid.
+ */
+static size_t point_count(const oshu::bezier *bezier)
+{
+	return bezier->indices[bezier->segment_count] + (bezier->extended ? 0 : 2);
+}
+
+/*****************************************************************************/
+/* Writing *******************************************************************/
+
+/**
+ * A block of the beatmap's arena, and the offset of its copy in the image.
+ */
+struct block_range {
+	const char *start;
+	size_t size;
+	size_t offset;
+};
+
+/**
+ * The cache image being built.
+ *
+ * Every object of the beatmap lives in its arena, so the image is built by
+ * copying the blocks of the arena one after the other, and the offset of an
+ * object in the image is found from its address with a binary search on the
+ * blocks. The only objects outside the arena are the strings, which point
+ * inside the beatmap's mapping, and are copied after the blocks.
+ *
+ * The size of the image is known from the arena beforehand, so it's allocated
+ * at once.
+ */
+struct cache_writer {
+	char *data;
+	size_t size;
+	/** The blocks of the arena, sorted by address. */
+	std::vector<struct block_range> blocks;
+	/** Where the next string is copied. */
+	size_t string_cursor;
+};
+
+/**
+ * Find the offset of the copy of an arena object in the image.
+ */
+static size_t offset_of(struct cache_writer *w, const void *object)
+{
+	const char *address = (const char*) object;
+	auto block = std::upper_bound(
+		w->blocks.begin(), w->blocks.end(), address,
+		[](const char *address, const struct block_range &block) { return address < block.start; }
+	);
+	assert (block != w->blocks.begin());
+	--block;
+	assert (address < block->start + block->size);
+	return block->offset + (address - block->start);
+}
+
+/**
+ * Return a pointer to the copy of *object* in the image.
+ */
+template <typename T>
+static T* copy_of(struct cache_writer *w, const T *object)
+{
+	return (T*) (w->data + offset_of(w, object));
+}
+
+/**
+ * Replace a pointer in the image by the offset of the object it points to.
+ */
+template <typename T>
+static void encode(struct cache_writer *w, T **field)
+{
+	if (*field)
+		*field = (T*) (uintptr_t) offset_of(w, *field);
+}
+
+/**
+ * Copy a string at the end of the image, and replace the pointer to it by
+ * the offset of the copy.
+ */
+static void encode_string(struct cache_writer *w, char **field)
+{
+	if (!*field)
+		return;
+	size_t size = strlen(*field) + 1;
+	assert (w->string_cursor + size <= w->size);
+	memcpy(w->data + w->string_cursor, *field, size);
+	*field = (char*) (uintptr_t) w->string_cursor;
+	w->string_cursor = align(w->string_cursor + size);
+}
+
+static size_t string_size(const char *str)
+{
+	return str ? align(strlen(str) + 1) : 0;
+}
+
+/**
+ * Lay the image out, and allocate it.
+ *
+ * The blocks are copied in the order they were allocated, which is roughly
+ * the order of the beatmap, then sorted by address for #offset_of.
+ */
+static int allocate_image(struct cache_writer *w, oshu::beatmap *beatmap)
+{
+	for (oshu::arena_block *block = beatmap->arena.blocks; block; block = block->previous) {
+		struct block_range range;
+		range.start = (char*) block + align(sizeof(*block));
+		char *end = block == beatmap->arena.blocks ? beatmap->arena.cursor : block->end;
+		range.size = end - range.start;
+		w->blocks.push_back(range);
+	}
+	std::reverse(w->blocks.begin(), w->blocks.end());
+	size_t size = align(beatmap_offset + sizeof(*beatmap));
+	for (struct block_range &range : w->blocks) {
+		range.offset = size;
+		size += align(range.size);
+	}
+	std::sort(
+		w->blocks.begin(), w->blocks.end(),
+		[](const struct block_range &a, const struct block_range &b) { return a.start < b.start; }
+	);
+	w->string_cursor = size;
+	oshu::metadata *meta = &beatmap->metadata;
+	size += string_size(beatmap->audio_filename);
+	size += string_size(beatmap->background_filename);
+	size += string_size(meta->title);
+	size += string_size(meta->title_unicode);
+	size += string_size(meta->artist);
+	size += string_size(meta->artist_unicode);
+	size += string_size(meta->creator);
+	size += string_size(meta->version);
+	size += string_size(meta->source);
+	w->size = size;
+	w->data = (char*) calloc(1, size);
+	return w->data ? 0 : -1;
+}
+
+/**
+ * A field of the arena that #copy_beatmap must not read.
+ */
+struct skipped_field {
+	const char *start;
+	size_t size;
+};
+
+template <typename T>
+static void skip(std::vector<struct skipped_field> *fields, const T *field, size_t count = 1)
+{
+	fields->push_back({(const char*) field, sizeof(T) * count});
+}
+
+/**
+ * Copy the beatmap structure and the arena into the image.
+ *
+ * The beatmap may be saved from the thread of #oshu::prefetch_paths while the
+ * game is playing it, so the fields the game writes are not read, and stay
+ * zero in the image: the state, offset and texture of every hit, and the
+ * states of the hit index. The rest of the beatmap doesn't change once the
+ * paths are normalized.
+ */
+static void copy_beatmap(struct cache_writer *w, oshu::beatmap *beatmap)
+{
+	memcpy((void*) (w->data + beatmap_offset), (void*) beatmap, sizeof(*beatmap));
+	std::vector<struct skipped_field> skipped;
+	for (oshu::hit *hit = beatmap->hits; hit; hit = hit->next) {
+		skip(&skipped, &hit->state);
+		skip(&skipped, &hit->offset);
+		skip(&skipped, &hit->texture);
+	}
+	if (beatmap->hit_index.states)
+		skip(&skipped, beatmap->hit_index.states, beatmap->hit_index.size);
+	std::sort(
+		skipped.begin(), skipped.end(),
+		[](const struct skipped_field &a, const struct skipped_field &b) { return a.start < b.start; }
+	);
+	auto field = skipped.begin();
+	for (const struct block_range &range : w->blocks) {
+		const char *cursor = range.start;
+		const char *end = range.start + range.size;
+		for (; field != skipped.end() && field->start < end; ++field) {
+			assert (field->start >= cursor);
+			memcpy(w->data + range.offset + (cursor - range.start), cursor, field->start - cursor);
+			cursor = field->start + field->size;
+		}
+		memcpy(w->data + range.offset + (cursor - range.start), cursor, end - cursor);
+	}
+	assert (field == skipped.end());
+}
+
+/**
+ * Turn every pointer of the image into an offset, and count the timing points
+ * and hit objects for the header.
+ *
+ * The copies are found from the original objects, which are walked again.
+ */
+static void encode_beatmap(struct cache_writer *w, oshu::beatmap *beatmap, struct cache_header *header)
+{
+	oshu::beatmap *copy = (oshu::beatmap*) (w->data + beatmap_offset);
+	oshu::metadata *meta = &copy->metadata;
+	copy->timing_index = {};
+	copy->hit_index = {};
+	copy->arena = {};
+	copy->mapping = nullptr;
+	copy->mapping_size = 0;
+	copy->prefetcher = nullptr;
+	encode_string(w, &copy->audio_filename);
+	encode_string(w, &copy->background_filename);
+	encode_string(w, &meta->title);
+	encode_string(w, &meta->title_unicode);
+	encode_string(w, &meta->artist);
+	encode_string(w, &meta->artist_unicode);
+	encode_string(w, &meta->creator);
+	encode_string(w, &meta->version);
+	encode_string(w, &meta->source);
+	meta->tags = nullptr;
+	encode(w, &copy->timing_points);
+	encode(w, &copy->colors);
+	encode(w, &copy->hits);
+	for (oshu::timing_point *t = beatmap->timing_points; t; t = t->next) {
+		encode(w, &copy_of(w, t)->next);
+		header->timing_point_count++;
+	}
+	oshu::color *color = beatmap->colors;
+	for (int i = 0; i < beatmap->color_count; ++i, color = color->next)
+		encode(w, &copy_of(w, color)->next);
+	for (oshu::hit *hit = beatmap->hits; hit; hit = hit->next) {
+		header->hit_count++;
+		oshu::hit *h = copy_of(w, hit);
+		encode(w, &h->timing_point);
+		encode(w, &h->color);
+		encode(w, &h->previous);
+		encode(w, &h->next);
+		if (!(h->type & oshu::SLIDER_HIT))
+			continue;
+		encode(w, &h->slider.sounds);
+		encode(w, &h->slider.edges);
+		encode(w, &h->slider.ticks);
+		if (h->slider.path.type == oshu::BEZIER_PATH) {
+			encode(w, &h->slider.path.bezier.indices);
+			encode(w, &h->slider.path.bezier.control_points);
+			encode(w, &h->slider.path.bezier.samples);
+			encode(w, &h->slider.path.bezier.distances);
+		} else if (h->slider.path.type == oshu::CATMULL_PATH) {
+			encode(w, &h->slider.path.catmull.control_points);
+			encode(w, &h->slider.path.catmull.samples);
+			encode(w, &h->slider.path.catmull.distances);
+		}
+	}
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t rc = write(fd, data, size);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0)
+			return -1;
+		data += rc;
+		size -= rc;
+	}
+	return 0;
+}
+
+void oshu::save_beatmap_cache(const char *path, const struct stat *source, oshu::beatmap *beatmap)
+{
+	std::string final_path;
+	if (cache_path(path, &final_path) < 0)
+		return;
+	if (oshu::make_directories(oshu::cache_directory("beatmaps")) < 0) {
+		oshu_log_warning("could not create the beatmap cache directory: %s", strerror(errno));
+		return;
+	}
+
+	for (oshu::hit *hit = beatmap->hits; hit; hit = hit->next) {
+		if (hit->type & oshu::SLIDER_HIT)
+			oshu::normalize_path(&hit->slider.path);
+	}
+	struct cache_writer w;
+	if (allocate_image(&w, beatmap) < 0) {
+		oshu_log_warning("could not allocate the beatmap cache");
+		return;
+	}
+	copy_beatmap(&w, beatmap);
+	struct cache_header header;
+	memset(&header, 0, sizeof(header));
+	encode_beatmap(&w, beatmap, &header);
+	memcpy(header.magic, cache_magic, sizeof(header.magic));
+	header.version = cache_version;
+	header.beatmap_size = sizeof(oshu::beatmap);
+	header.hit_size = sizeof(oshu::hit);
+	header.source_mtime = mtime(source);
+	header.source_size = source->st_size;
+	header.size = w.size;
+	memcpy(w.data, &header, sizeof(header));
+
+	std::string temporary_path = final_path + ".XXXXXX";
+	int fd = mkstemp(&temporary_path[0]);
+	if (fd < 0) {
+		oshu_log_warning("could not create the beatmap cache: %s", strerror(errno));
+		free(w.data);
+		return;
+	}
+	int rc = write_all(fd, w.data, w.size);
+	free(w.data);
+	if (close(fd) < 0)
+		rc = -1;
+	if (rc < 0 || rename(temporary_path.c_str(), final_path.c_str()) < 0) {
+		oshu_log_warning("could not write the beatmap cache: %s", strerror(errno));
+		unlink(temporary_path.c_str());
+		return;
+	}
+	oshu_log_debug("saved the beatmap cache %s", final_path.c_str());
+}
+
+/*****************************************************************************/
+/* Reading *******************************************************************/
+
+/**
+ * The cache image loaded in memory.
+ *
+ * One byte past #size is always zero, so that any offset within the image is
+ * a valid null-terminated string.
+ */
+struct cache_reader {
+	char *base;
+	size_t size;
+};
+
+/**
+ * Turn an offset read from the image back into a pointer.
+ *
+ * Make sure the *count* objects it points to lie inside the image, as a
+ * corrupt cache must not make us read random memory.
+ */
+template <typename T>
+static int relocate(struct cache_reader *r, T **field, size_t count = 1)
+{
+	uintptr_t offset = (uintptr_t) *field;
+	if (offset == 0)
+		return 0;
+	if (offset % alignof(T) || offset >= r->size || count > (r->size - offset) / sizeof(T))
+		return -1;
+	*field = (T*) (r->base + offset);
+	return 0;
+}
+
+static int relocate_hit(struct cache_reader *r, oshu::hit *hit)
+{
+	if (relocate(r, &hit->timing_point) < 0)
+		return -1;
+	if (relocate(r, &hit->color) < 0)
+		return -1;
+	if (relocate(r, &hit->previous) < 0)
+		return -1;
+	if (relocate(r, &hit->next) < 0)
+		return -1;
+	if (!(hit->type & oshu::SLIDER_HIT))
+		return 0;
+	if (hit->slider.path.state != oshu::NORMALIZED_PATH)
+		return -1;
+	if (hit->slider.repeat < 1 || relocate(r, &hit->slider.sounds, hit->slider.repeat + 1) < 0)
+		return -1;
+	if (relocate(r, &hit->slider.edges, hit->slider.repeat + 1) < 0)
+		return -1;
+	if (hit->slider.tick_count < 0 || relocate(r, &hit->slider.ticks, hit->slider.tick_count) < 0)
+		return -1;
+	if (hit->slider.path.type == oshu::BEZIER_PATH) {
+		oshu::bezier *bezier = &hit->slider.path.bezier;
+		if (bezier->segment_count < 1 || !bezier->indices || !bezier->control_points)
+			return -1;
+		if (relocate(r, &bezier->indices, index_count(bezier)) < 0)
+			return -1;
+		if (bezier->indices[bezier->segment_count] < 2 || relocate(r, &bezier->control_points, point_count(bezier)) < 0)
+			return -1;
+		if (bezier->sample_count < 2 || bezier->sample_count > bezier->sample_capacity)
+			return -1;
+		if (!bezier->samples || relocate(r, &bezier->samples, bezier->sample_count) < 0)
+			return -1;
+		if (!bezier->distances || relocate(r, &bezier->distances, bezier->sample_count) < 0)
+			return -1;
+	} else if (hit->slider.path.type == oshu::CATMULL_PATH) {
+		oshu::catmull *catmull = &hit->slider.path.catmull;
+		if (catmull->point_count < 2 || !catmull->control_points || relocate(r, &catmull->control_points, catmull->point_count) < 0)
+			return -1;
+		if (catmull->sample_count < 2 || catmull->sample_count > catmull->sample_capacity)
+			return -1;
+		if (!catmull->samples || relocate(r, &catmull->samples, catmull->sample_count) < 0)
+			return -1;
+		if (!catmull->distances || relocate(r, &catmull->distances, catmull->sample_count) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Relocate every pointer of the image, walking the objects from the beatmap
+ * structure.
+ *
+ * Lists are walked for exactly as many elements as the header announced, so
+ * that a corrupt cache can't make us loop forever.
+ */
+static int relocate_beatmap(struct cache_reader *r, const struct cache_header *header)
+{
+	oshu::beatmap *beatmap = (oshu::beatmap*) (r->base + beatmap_offset);
+	oshu::metadata *meta = &beatmap->metadata;
+	if (relocate(r, &beatmap->audio_filename) < 0
+	    || relocate(r, &beatmap->background_filename) < 0
+	    || relocate(r, &meta->title) < 0
+	    || relocate(r, &meta->title_unicode) < 0
+	    || relocate(r, &meta->artist) < 0
+	    || relocate(r, &meta->artist_unicode) < 0
+	    || relocate(r, &meta->creator) < 0
+	    || relocate(r, &meta->version) < 0
+	    || relocate(r, &meta->source) < 0)
+		return -1;
+	meta->tags = nullptr;
+
+	if (relocate(r, &beatmap->timing_points) < 0)
+		return -1;
+	oshu::timing_point *t = beatmap->timing_points;
+	for (uint32_t i = 0; i < header->timing_point_count; ++i, t = t->next) {
+		if (!t || relocate(r, &t->next) < 0)
+			return -1;
+	}
+	if (t)
+		return -1;
+
+	if (beatmap->color_count < 0 || !beatmap->colors != !beatmap->color_count)
+		return -1;
+	if (relocate(r, &beatmap->colors) < 0)
+		return -1;
+	oshu::color *color = beatmap->colors;
+	for (int i = 0; i < beatmap->color_count; ++i, color = color->next) {
+		if (!color->next || relocate(r, &color->next) < 0)
+			return -1;
+	}
+
+	if (header->hit_count < 2 || !beatmap->hits || relocate(r, &beatmap->hits) < 0)
+		return -1;
+	oshu::hit *hit = beatmap->hits;
+	for (uint32_t i = 0; i < header->hit_count; ++i, hit = hit->next) {
+		if (!hit || relocate_hit(r, hit) < 0)
+			return -1;
+	}
+	if (hit)
+		return -1;
+	return 0;
+}
+
+static int read_all(int fd, char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t rc = read(fd, data, size);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			return -1;
+		data += rc;
+		size -= rc;
+	}
+	return 0;
+}
+
+static int check_header(const struct cache_header *header, const struct stat *source, size_t size)
+{
+	if (memcmp(header->magic, cache_magic, sizeof(header->magic)))
+		return -1;
+	if (header->version != cache_version)
+		return -1;
+	if (header->beatmap_size != sizeof(oshu::beatmap) || header->hit_size != sizeof(oshu::hit))
+		return -1;
+	if (header->source_mtime != mtime(source) || header->source_size != (uint64_t) source->st_size)
+		return -1;
+	if (header->size != size || size < beatmap_offset + sizeof(oshu::beatmap))
+		return -1;
+	return 0;
+}
+
+int oshu::load_beatmap_cache(const char *path, const struct stat *source, oshu::beatmap *beatmap)
+{
+	std::string cache;
+	if (cache_path(path, &cache) < 0)
+		return -1;
+	int fd = open(cache.c_str(), O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat s;
+	if (fstat(fd, &s) < 0 || (size_t) s.st_size < sizeof(struct cache_header)) {
+		close(fd);
+		return -1;
+	}
+	oshu::arena arena {};
+	struct cache_reader r;
+	r.size = s.st_size;
+	r.base = (char*) oshu::arena_alloc(&arena, r.size + 1);
+	int rc = read_all(fd, r.base, r.size);
+	close(fd);
+	const struct cache_header *header = (const struct cache_header*) r.base;
+	if (rc < 0 || check_header(header, source, r.size) < 0) {
+		oshu_log_debug("ignoring the stale or invalid beatmap cache %s", cache.c_str());
+		oshu::destroy_arena(&arena);
+		return -1;
+	}
+	if (relocate_beatmap(&r, header) < 0) {
+		oshu_log_warning("corrupt beatmap cache %s", cache.c_str());
+		oshu::destroy_arena(&arena);
+		return -1;
+	}
+	memcpy((void*) beatmap, r.base + beatmap_offset, sizeof(*beatmap));
+	beatmap->arena = arena;
+	oshu_log_debug("loaded the beatmap from its cache %s", cache.c_str());
+	return 0;
+}
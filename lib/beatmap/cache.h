@@ -0,0 +1,85 @@
+/**
+ * \file beatmap/cache.h
+ * \ingroup beatmap
+ *
+ * \brief
+ * Internal header for the compiled beatmap cache.
+ *
+ * Parsing a long beatmap takes a measurable time at startup. Once the beatmap
+ * being played was parsed, we save all the objects the parser produced to a
+ * binary file in the cache directory, `$XDG_CACHE_HOME/oshu/beatmaps` or
+ * `$HOME/.cache/oshu/beatmaps`. The file is named after the 64-bit FNV-1a hash
+ * of the real path of the beatmap. The next time the beatmap is loaded, that
+ * file is read instead.
+ *
+ * The cache file is a header followed by a flat image of the beatmap:
+ *
+ * 1. the #oshu::beatmap structure itself,
+ * 2. every block of the beatmap's arena, in allocation order, which hold all
+ *    the timing points, colors, hit objects, and slider data,
+ * 3. the strings, which the parser left in the beatmap's mapping.
+ *
+ * The arena also holds a few objects that aren't part of the beatmap proper,
+ * like the indices. They're saved along with the rest, unused, as skipping them
+ * would cost more than the few bytes they take.
+ *
+ * The slider paths are normalized before they're saved, so that a beatmap
+ * loaded from its cache has its polylines ready, and its sample arrays hold
+ * actual points. See #oshu::normalize_path.
+ *
+ * Every object is stored as it is in memory, except the pointers which are
+ * replaced by their offset from the beginning of the file, 0 meaning NULL.
+ * Because the objects keep their position in their arena block, the offset of
+ * any object is the offset of its block in the image plus its position in the
+ * block. Loading the cache is a single read into the beatmap's arena, followed
+ * by a pass to turn the offsets back into pointers.
+ *
+ * Because the structures are stored raw, the cache is only readable by a
+ * build of oshu! with the same structure layout. The header records a format
+ * version, which must be bumped whenever the beatmap structures change, along
+ * with the size of the main structures, to detect the other cases.
+ *
+ * The header also records the modification time and the size of the beatmap
+ * file when the cache was built. When they don't match the beatmap file
+ * anymore, the cache is ignored and rebuilt.
+ */
+
+#pragma once
+
+#include "beatmap/beatmap.h"
+
+#include <sys/stat.h>
+
+namespace oshu {
+
+/**
+ * Load the beatmap from the cache of the beatmap file at *path*.
+ *
+ * *source* is the status of the beatmap file, as returned by *stat*, to check
+ * the cache is fresh.
+ *
+ * On success, the beatmap is fully loaded, except for its
+ * #oshu::beatmap::timing_index and #oshu::beatmap::hit_index, which are left
+ * empty. Its slider paths are all normalized. Its strings point inside the
+ * arena, and it has no #oshu::beatmap::mapping.
+ *
+ * Return -1 if the cache is missing, stale, or invalid. In that case, the
+ * beatmap is left untouched.
+ */
+int load_beatmap_cache(const char *path, const struct stat *source, oshu::beatmap *beatmap);
+
+/**
+ * Save a freshly parsed beatmap to the cache of the beatmap file at *path*.
+ *
+ * Every slider path is normalized first. See #oshu::cache_beatmap.
+ *
+ * The file is written under a unique temporary name, then renamed, so that a
+ * concurrent reader never sees a partial cache, even when two threads save the
+ * same beatmap.
+ *
+ * Failing to write the cache is not an error for the caller, as the beatmap
+ * can always be parsed again, so this function only logs a warning.
+ */
+void save_beatmap_cache(const char *path, const struct stat *source, oshu::beatmap *beatmap);
+
+}
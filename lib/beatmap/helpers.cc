@@ -8,14 +8,41 @@
 
 #include "beatmap/beatmap.h"
 
+#include <assert.h>
+
 double oshu::hit_end_time(oshu::hit *hit)
 {
 	if (hit->type & oshu::SLIDER_HIT)
-		return hit->time + hit->slider.duration * hit->slider.repeat;
+		return hit->slider.end_time;
 	else
 		return hit->time;
 }
 
+int oshu::slider_run(const oshu::hit *hit, double time)
+{
+	assert (hit->type & oshu::SLIDER_HIT);
+	const double *edges = hit->slider.edges;
+	/* edges[low] <= time < edges[high], clamped */
+	int low = 0;
+	int high = hit->slider.repeat;
+	while (high - low > 1) {
+		int middle = low + (high - low) / 2;
+		if (edges[middle] <= time)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+oshu::point oshu::slider_ball(oshu::hit *hit, double time)
+{
+	int run = oshu::slider_run(hit, time);
+	double t = (time - hit->slider.edges[run]) / hit->slider.duration;
+	t = t < 0 ? 0 : t > 1 ? 1 : t;
+	return oshu::path_at(&hit->slider.path, run % 2 ? 1 - t : t);
+}
+
 oshu::point oshu::end_point(oshu::hit *hit)
 {
 	if (hit->type & oshu::SLIDER_HIT)
@@ -23,3 +50,61 @@ oshu::point oshu::end_point(oshu::hit *hit)
 	else
 		return hit->p;
 }
+
+oshu::timing_point* oshu::timing_point_at(const oshu::beatmap *beatmap, double time)
+{
+	const oshu::timing_index *index = &beatmap->timing_index;
+	if (index->size == 0)
+		return NULL;
+	/* offsets[low] <= time < offsets[high], with virtual bounds */
+	int low = 0;
+	int high = index->size;
+	while (high - low > 1) {
+		int middle = low + (high - low) / 2;
+		if (index->offsets[middle] <= time)
+			low = middle;
+		else
+			high = middle;
+	}
+	return index->points[low];
+}
+
+int oshu::find_last_hit(const oshu::hit_index *index, double time)
+{
+	assert (index->size >= 2);
+	/* times[low] <= time < times[high] */
+	int low = 0;
+	int high = index->size - 1;
+	while (high - low > 1) {
+		int middle = low + (high - low) / 2;
+		if (index->times[middle] <= time)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+int oshu::find_active_hit(const oshu::hit_index *index, double time)
+{
+	assert (index->size >= 2);
+	/* reach[low] < time <= reach[high] */
+	int low = 0;
+	int high = index->size - 1;
+	while (high - low > 1) {
+		int middle = low + (high - low) / 2;
+		if (index->reach[middle] < time)
+			low = middle;
+		else
+			high = middle;
+	}
+	return high;
+}
+
+void oshu::set_hit_state(oshu::beatmap *beatmap, oshu::hit *hit, enum oshu::hit_state state)
+{
+	hit->state = state;
+	assert (hit->index >= 0 && hit->index < beatmap->hit_index.size);
+	assert (beatmap->hit_index.hits[hit->index] == hit);
+	beatmap->hit_index.states[hit->index] = state;
+}
@@ -6,15 +6,22 @@
  * Beatmap loader.
  */
 
+#include "./cache.h"
 #include "./parser.h"
 #include "beatmap/beatmap.h"
 #include "core/log.h"
+#include "core/number.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
 
 /**
  * Every osu beatmap file must begin with this.
@@ -48,9 +55,15 @@ static const oshu::beatmap default_beatmap = {
 	},
 	.background_filename = nullptr,
 	.timing_points = nullptr,
+	.timing_index = {},
 	.colors = nullptr,
 	.color_count = 0,
 	.hits = nullptr,
+	.hit_index = {},
+	.arena = {},
+	.mapping = nullptr,
+	.mapping_size = 0,
+	.prefetcher = nullptr,
 };
 
 /**
@@ -138,7 +151,7 @@ static int parse_char(struct parser_state *parser, char *c)
 static int parse_int(struct parser_state *parser, int *value)
 {
 	char *end;
-	*value = strtol(parser->input, &end, 10);
+	*value = oshu::read_integer(parser->input, &end);
 	if (end == parser->input) {
 		parser_error(parser, "expected a number");
 		return -1;
@@ -165,7 +178,7 @@ static int parse_int_sep(struct parser_state *parser, int *value, char sep)
 static int parse_double(struct parser_state *parser, double *value)
 {
 	char *end;
-	*value = strtod(parser->input, &end);
+	*value = oshu::read_decimal(parser->input, &end);
 	if (end == parser->input) {
 		parser_error(parser, "expected a floating number");
 		return -1;
@@ -190,14 +203,14 @@ static int parse_double_sep(struct parser_state *parser, double *value, char sep
 /**
  * Parse the remaining of the input as a string.
  *
- * It is not trimmed here. #process_input trims the end of the string, and
+ * It is not trimmed here. #parse_file trims the end of the line, and
  * #parse_key will trim the start for you. Otherwise, call #consume_spaces to
  * trim the start.
  *
  * If the string is empty, `*str` is set to NULL.
  *
- * Otherwise, return a dynamically allocated string using *strdup*, which you
- * must not forget to free!
+ * Otherwise, `*str` points to the input buffer, which is the beatmap's
+ * #oshu::beatmap::mapping. No copy is made, so don't free it.
  */
 static int parse_string(struct parser_state *parser, char **str)
 {
@@ -205,9 +218,8 @@ static int parse_string(struct parser_state *parser, char **str)
 		*str = NULL;
 		return 0;
 	} else {
-		int len = strlen(parser->input);
-		*str = strdup(parser->input);
-		parser->input += len;
+		*str = parser->input;
+		parser->input += strlen(parser->input);
 		return 0;
 	}
 }
@@ -218,7 +230,8 @@ static int parse_string(struct parser_state *parser, char **str)
  * Mainly useful for parsing the file name of the background picture in the
  * events section.
  *
- * Behaves like #parse_string.
+ * Behaves like #parse_string. The closing quote is overwritten with a null
+ * byte to terminate the string in place.
  */
 static int parse_quoted_string(struct parser_state *parser, char **str)
 {
@@ -236,7 +249,7 @@ static int parse_quoted_string(struct parser_state *parser, char **str)
 		*str = NULL;
 		return 0;
 	} else {
-		*str = strdup(parser->input);
+		*str = parser->input;
 		parser->input = end + 1;
 	}
 	return 0;
@@ -246,41 +259,97 @@ static int parse_quoted_string(struct parser_state *parser, char **str)
  * Map each token to its string representation using CPP's magic
  * stringification operator.
  */
-static const char* token_strings[NUM_TOKENS] = {
+static constexpr const char* token_strings[NUM_TOKENS] = {
 #define TOKEN(t) #t,
 #include "./tokens.h"
 #undef TOKEN
 };
 
+static constexpr int token_length(const char *str)
+{
+	int len = 0;
+	while (str[len])
+		++len;
+	return len;
+}
+
 /**
- * Perform a dichotomic search using #token_strings.
+ * Number of slots in the #token_table.
+ */
+static constexpr int token_table_size = 256;
+
+/**
+ * Hash a token from its length, its first two characters and its last one.
  *
- * The *str* argument isn't expected to be null-terminated at *len*, so we must
- * make sure we take the length into account when comparing tokens, and not
- * listen too much to *strncmp* which would return 0 if *str* is a prefix of
- * the candidate token.
+ * The coefficients were found by brute force so that no two tokens from
+ * tokens.h share the same hash. When adding a token, the static assertion
+ * below #token_table tells whether they're still good. If not, search for new
+ * ones.
  */
-static int search_token(const char *str, int len, enum token *token)
+static constexpr int token_hash(const char *str, int len)
 {
-	int start = 0;
-	int end = NUM_TOKENS - 1; /* inclusive */
-	while (start <= end) {
-		int middle = start + (end - start) / 2;
-		const char *repr = token_strings[middle];
-		int cmp = strncmp(str, repr, len);
-		if (cmp == 0)
-			cmp = len - strlen(repr);
-		if (cmp == 0) {
-			/* Found! */
-			*token = (enum token) middle;
-			return 0;
-		} else if (cmp < 0) {
-			end = middle - 1;
-		} else {
-			start = middle + 1;
-		}
+	return ((unsigned char) str[0]
+	        + 10 * (unsigned char) str[1]
+	        + 12 * (unsigned char) str[len - 1]
+	        + 4 * len) % token_table_size;
+}
+
+struct token_hash_table {
+	/**
+	 * The token whose hash is the index in this array, or -1.
+	 */
+	signed char slots[token_table_size];
+	/**
+	 * False if two tokens share the same hash.
+	 */
+	bool perfect;
+};
+
+static constexpr struct token_hash_table build_token_table()
+{
+	struct token_hash_table table {};
+	table.perfect = true;
+	for (int i = 0; i < token_table_size; ++i)
+		table.slots[i] = -1;
+	for (int t = 0; t < NUM_TOKENS; ++t) {
+		const char *str = token_strings[t];
+		int len = token_length(str);
+		if (len < 2)
+			table.perfect = false;
+		int hash = token_hash(str, len);
+		if (table.slots[hash] >= 0)
+			table.perfect = false;
+		table.slots[hash] = t;
 	}
-	return -1;
+	return table;
+}
+
+/**
+ * Perfect hash table of the tokens, computed at compile time.
+ */
+static constexpr struct token_hash_table token_table = build_token_table();
+
+static_assert(NUM_TOKENS < 128, "too many tokens for the token table");
+static_assert(token_table.perfect, "token hash collision, update token_hash");
+
+/**
+ * Find a token using the perfect hash #token_table.
+ *
+ * The *str* argument isn't expected to be null-terminated at *len*, so the
+ * candidate token must be checked to end at *len* too.
+ */
+static int search_token(const char *str, int len, enum token *token)
+{
+	if (len < 2)
+		return -1;
+	int candidate = token_table.slots[token_hash(str, len)];
+	if (candidate < 0)
+		return -1;
+	const char *repr = token_strings[candidate];
+	if (strncmp(str, repr, len) || repr[len] != '\0')
+		return -1;
+	*token = (enum token) candidate;
+	return 0;
 }
 
 static int parse_token(struct parser_state *parser, enum token *token)
@@ -381,6 +450,8 @@ static int process_section(struct parser_state *parser)
 	if (consume_char(parser, ']') < 0)
 		return -1;
 
+	if (parser->listener && parser->section >= 0)
+		parser->listener->section(*parser->beatmap, token_strings[parser->section]);
 	switch (token) {
 	case General:
 	case Editor:
@@ -397,8 +468,10 @@ static int process_section(struct parser_state *parser)
 		parser->section = BEATMAP_UNKNOWN;
 		return -1;
 	}
-	if (parser->section == BEATMAP_HIT_OBJECTS)
+	if (parser->section == BEATMAP_HIT_OBJECTS) {
 		validate_colors(parser);
+		reserve_hits(parser);
+	}
 	return 0;
 }
 
@@ -609,7 +682,6 @@ static int process_timing_point(struct parser_state *parser)
 		return -1;
 	if (parser->last_timing_point && timing->offset < parser->last_timing_point->offset) {
 		parser_error(parser, "misordered timing point");
-		free(timing);
 		return -1;
 	}
 	/* link it to the timing points list */
@@ -618,14 +690,15 @@ static int process_timing_point(struct parser_state *parser)
 	else
 		parser->beatmap->timing_points = timing;
 	parser->last_timing_point = timing;
+	if (parser->listener)
+		parser->listener->timing_point(*parser->beatmap, timing);
 	return 0;
 }
 
 static int parse_timing_point(struct parser_state *parser, oshu::timing_point **timing)
 {
 	int value;
-	*timing = (oshu::timing_point*) calloc(1, sizeof(**timing));
-	assert (timing != NULL);
+	*timing = (oshu::timing_point*) oshu::arena_alloc(&parser->beatmap->arena, sizeof(**timing));
 	/* 1. Timing offset. */
 	if (parse_double_sep(parser, &(*timing)->offset, ',') < 0)
 		goto fail;
@@ -646,6 +719,7 @@ static int parse_timing_point(struct parser_state *parser, oshu::timing_point **
 		parser_error(parser, "invalid beat duration %f", (*timing)->beat_duration);
 		goto fail;
 	}
+	(*timing)->base_beat_duration = parser->timing_base;
 	/* 3. Number of beats per measure. */
 	if (parse_int_sep(parser, &(*timing)->meter, ',') < 0)
 		goto fail;
@@ -677,7 +751,6 @@ static int parse_timing_point(struct parser_state *parser, oshu::timing_point **
 		goto fail;
 	return 0;
 fail:
-	free(*timing);
 	*timing = NULL;
 	return -1;
 }
@@ -745,8 +818,7 @@ static int process_color_combo(struct parser_state *parser)
 
 static int parse_color(struct parser_state *parser, oshu::color **color)
 {
-	*color = (oshu::color*) calloc(1, sizeof(**color));
-	assert (color != NULL);
+	*color = (oshu::color*) oshu::arena_alloc(&parser->beatmap->arena, sizeof(**color));
 	if (parse_color_channel(parser, &(*color)->red) < 0)
 		goto fail;
 	if (consume_char(parser, ',') < 0)
@@ -759,7 +831,6 @@ static int parse_color(struct parser_state *parser, oshu::color **color)
 		goto fail;
 	return 0;
 fail:
-	free(*color);
 	*color = NULL;
 	return -1;
 }
@@ -782,7 +853,7 @@ static void validate_colors(struct parser_state *parser)
 	if (parser->beatmap->colors)
 		return;
 	oshu_log_debug("no colors; generating a default color scheme");
-	oshu::color *color = (oshu::color*) calloc(1, sizeof(*color));
+	oshu::color *color = (oshu::color*) oshu::arena_alloc(&parser->beatmap->arena, sizeof(*color));
 	color->red = color->green = color->blue = 128;
 	color->next = color;
 	parser->beatmap->colors = color;
@@ -793,26 +864,120 @@ static void validate_colors(struct parser_state *parser)
 /* Hit objects ***************************************************************/
 
 /**
- * Set the parser's current timing point to the position in seconds specified
- * in *offset*.
+ * Tell whether the hit objects are thrown away once the listener has seen
+ * them. See #oshu::beatmap_listener::keep_hits.
+ */
+static bool discarding_hits(struct parser_state *parser)
+{
+	return parser->listener && !parser->listener->keep_hits;
+}
+
+/**
+ * Arena to allocate the hit objects and their sliders from.
  *
- * Return the appropriate object, or NULL on error.
+ * It's the beatmap's, unless the hits are discarded, in which case it's one of
+ * the #parser_state::scratch arenas.
+ */
+static oshu::arena* hit_arena(struct parser_state *parser)
+{
+	if (discarding_hits(parser))
+		return &parser->scratch[parser->scratch_index];
+	return &parser->beatmap->arena;
+}
+
+/**
+ * Reserve the #parser_state::hit_table from the beatmap's arena.
  *
- * The result is stored in #parser_state::current_timing_point for faster
- * results on further calls, assuming you'd never seek to a point before the
- * last seek.
+ * The remaining lines are counted with *memchr*, and each of them gets a slot,
+ * plus one for the final unreachable hit object. Comments and empty lines make
+ * it a slight overestimate, which is cheaper than growing the array.
  */
-static oshu::timing_point* seek_timing_point(double offset, struct parser_state *parser)
+static void reserve_hits(struct parser_state *parser)
 {
-	if (parser->current_timing_point == NULL)
-		parser->current_timing_point = parser->beatmap->timing_points;
-	/* update the parser state as we loop */
-	oshu::timing_point **tp = &parser->current_timing_point;
-	for (; *tp && (*tp)->next; *tp = (*tp)->next) {
-		if ((*tp)->next->offset > offset)
+	if (parser->hit_table || discarding_hits(parser))
+		return;
+	int lines = 1;
+	char *c = parser->next_line;
+	while (c < parser->input_end) {
+		c = (char*) memchr(c, '\n', parser->input_end - c);
+		if (!c)
 			break;
+		++c;
+		++lines;
+	}
+	parser->hit_capacity = lines + 1;
+	parser->hit_count = 0;
+	parser->hit_table = (oshu::hit*) oshu::arena_alloc(&parser->beatmap->arena, parser->hit_capacity * sizeof(*parser->hit_table));
+}
+
+/**
+ * Take the next free slot of the #parser_state::hit_table.
+ *
+ * If there is no table, or if it is full, which only happens with unusual
+ * files containing many [HitObjects] sections, fall back on allocating the hit
+ * on its own from the arena.
+ */
+static oshu::hit* allocate_hit(struct parser_state *parser)
+{
+	if (parser->hit_count < parser->hit_capacity)
+		return &parser->hit_table[parser->hit_count++];
+	return (oshu::hit*) oshu::arena_alloc(hit_arena(parser), sizeof(oshu::hit));
+}
+
+/**
+ * Give back a hit that failed to parse.
+ *
+ * When it is the last slot of the table, the slot is cleared and reused for
+ * the next hit. Otherwise it's simply abandoned in the arena.
+ */
+static void release_hit(struct parser_state *parser, oshu::hit *hit)
+{
+	if (parser->hit_count > 0 && hit == &parser->hit_table[parser->hit_count - 1]) {
+		memset((void*) hit, 0, sizeof(*hit));
+		parser->hit_count--;
 	}
-	return *tp;
+}
+
+/**
+ * Build the #oshu::beatmap::timing_index from the linked list of timing
+ * points.
+ *
+ * The arrays are allocated from the beatmap's arena. When the index is
+ * rebuilt, the previous arrays are left there.
+ */
+static void index_timing_points(oshu::beatmap *beatmap)
+{
+	oshu::timing_index *index = &beatmap->timing_index;
+	oshu::arena *arena = &beatmap->arena;
+	int size = 0;
+	for (oshu::timing_point *t = beatmap->timing_points; t; t = t->next)
+		++size;
+	index->size = size;
+	index->points = (oshu::timing_point**) oshu::arena_alloc(arena, size * sizeof(*index->points));
+	index->offsets = (double*) oshu::arena_alloc(arena, size * sizeof(*index->offsets));
+	int i = 0;
+	for (oshu::timing_point *t = beatmap->timing_points; t; t = t->next, ++i) {
+		index->points[i] = t;
+		index->offsets[i] = t->offset;
+	}
+}
+
+/**
+ * Find the timing point in effect at the position in seconds specified in
+ * *offset*.
+ *
+ * Return the appropriate object, or NULL if there are no timing points.
+ *
+ * The #oshu::beatmap::timing_index is built on the first call, and rebuilt if
+ * timing points were added since, which only happens when the sections are in
+ * an unusual order.
+ */
+static oshu::timing_point* seek_timing_point(double offset, struct parser_state *parser)
+{
+	oshu::timing_index *index = &parser->beatmap->timing_index;
+	if (parser->last_timing_point && (index->size == 0 || index->points[index->size - 1] != parser->last_timing_point))
+		index_timing_points(parser->beatmap);
+	return oshu::timing_point_at(parser->beatmap, offset);
 }
 
 /**
@@ -882,19 +1047,26 @@ static int process_hit_object(struct parser_state *parser)
 	assert (parser->last_hit != NULL);
 	if (hit->time < parser->last_hit->time) {
 		parser_error(parser, "missorted hit object");
-		free(hit);
+		release_hit(parser, hit);
 		return -1;
 	}
 	parser->last_hit->next = hit;
 	hit->previous = parser->last_hit;
 	parser->last_hit = hit;
+	if (parser->listener)
+		parser->listener->hit(*parser->beatmap, hit);
+	if (discarding_hits(parser)) {
+		/* the other arena contains the previous hit */
+		parser->scratch_index ^= 1;
+		oshu::clear_arena(&parser->scratch[parser->scratch_index]);
+	}
 	return 0;
 }
 
 /**
  * Allocate and parse one hit object.
  *
- * On failure, return -1, free any allocated memory, and leave `*hit`
+ * On failure, return -1, release the hit's slot, and leave `*hit`
  * unspecified.
  *
  * Consumes:
@@ -902,8 +1074,7 @@ static int process_hit_object(struct parser_state *parser)
  */
 static int parse_hit_object(struct parser_state *parser, oshu::hit **hit)
 {
-	*hit = (oshu::hit*) calloc(1, sizeof(**hit));
-	assert (*hit != NULL);
+	*hit = allocate_hit(parser);
 	if (parse_common_hit(parser, *hit) < 0)
 		goto fail;
 	(*hit)->timing_point = seek_timing_point((*hit)->time, parser);
@@ -934,7 +1105,7 @@ static int parse_hit_object(struct parser_state *parser, oshu::hit **hit)
 		fill_slider_additions(*hit);
 	return 0;
 fail:
-	free(*hit);
+	release_hit(parser, *hit);
 	*hit = NULL;
 	return -1;
 }
@@ -973,6 +1144,7 @@ static int parse_common_hit(struct parser_state *parser, oshu::hit *hit)
  * - `P|396:140|448:80,1,140,0|8,1:0|0:0`
  * - `L|168:88,1,70,8|0,0:0|0:0`
  * - `B|460:188|408:240|408:240|416:280,1,140,4|2,1:2|0:3`
+ * - `C|288:112|320:96|352:128,1,105`
  *
  * Some sliders are shorter and omit the slider additions, like that:
  * `160,76,142685,6,0,B|156:120|116:152,1,70,8|0`
@@ -989,6 +1161,7 @@ static int parse_slider(struct parser_state *parser, oshu::hit *hit)
 	case oshu::LINEAR_PATH:  rc = parse_linear_slider(parser, hit); break;
 	case oshu::PERFECT_PATH: rc = parse_perfect_slider(parser, hit); break;
 	case oshu::BEZIER_PATH:  rc = parse_bezier_slider(parser, hit); break;
+	case oshu::CATMULL_PATH: rc = parse_catmull_slider(parser, hit); break;
 	default:
 		parser_error(parser, "unknown slider type");
 		return -1;
@@ -999,15 +1172,71 @@ static int parse_slider(struct parser_state *parser, oshu::hit *hit)
 		return -1;
 	if (parse_int_sep(parser, &hit->slider.repeat, ',') < 0)
 		return -1;
+	if (hit->slider.repeat < 1) {
+		parser_error(parser, "invalid slider repeat count %d", hit->slider.repeat);
+		return -1;
+	}
 	if (parse_double(parser, &hit->slider.length) < 0)
 		return -1;
 	hit->slider.duration = hit->slider.length / (100. * parser->beatmap->difficulty.slider_multiplier) * hit->timing_point->beat_duration;
-	oshu::normalize_path(&hit->slider.path, hit->slider.length);
+	hit->slider.path.length = hit->slider.length;
+	reserve_samples(parser, hit);
+	time_slider(parser, hit);
 	if (parse_slider_additions(parser, hit) < 0)
 		return -1;
 	return 0;
 }
 
+/**
+ * Ticks closer than this to the end of a run are dropped, in seconds.
+ */
+static const double tick_margin = .01;
+
+/**
+ * Upper bound on the number of ticks per run, to protect against absurd beat
+ * durations.
+ */
+static const int max_ticks = 1024;
+
+/**
+ * Fill the #oshu::slider::end_time, #oshu::slider::edges and
+ * #oshu::slider::ticks of a slider whose duration and repeat count are known.
+ *
+ * The ticks are placed on the first run, then repeated on the following ones,
+ * mirrored on the reversed runs so that they stay at the same place on the
+ * path.
+ */
+static void time_slider(struct parser_state *parser, oshu::hit *hit)
+{
+	oshu::slider *slider = &hit->slider;
+	oshu::arena *arena = hit_arena(parser);
+	slider->end_time = hit->time + slider->duration * slider->repeat;
+	slider->edges = (double*) oshu::arena_alloc(arena, (slider->repeat + 1) * sizeof(*slider->edges));
+	for (int i = 0; i < slider->repeat; ++i)
+		slider->edges[i] = hit->time + i * slider->duration;
+	slider->edges[slider->repeat] = slider->end_time;
+
+	double rate = parser->beatmap->difficulty.slider_tick_rate;
+	double interval = rate > 0 ? hit->timing_point->base_beat_duration / rate : 0;
+	int per_run = 0;
+	while (interval > 0 && per_run < max_ticks && (per_run + 1) * interval < slider->duration - tick_margin)
+		++per_run;
+	slider->tick_count = per_run * slider->repeat;
+	if (slider->tick_count == 0)
+		return;
+	slider->ticks = (double*) oshu::arena_alloc(arena, slider->tick_count * sizeof(*slider->ticks));
+	double *tick = slider->ticks;
+	for (int run = 0; run < slider->repeat; ++run) {
+		double start = slider->edges[run];
+		for (int i = 1; i <= per_run; ++i) {
+			if (run % 2 == 0)
+				*tick++ = start + i * interval;
+			else
+				*tick++ = start + slider->duration - (per_run + 1 - i) * interval;
+		}
+	}
+}
+
 /**
  * Consumes:
  * `168:88`
@@ -1089,8 +1318,11 @@ static int parse_perfect_slider(struct parser_state *parser, oshu::hit *hit)
  * case in the drawing procedure. A smart processing could handle some cases,
  * but there are no right solution since the format is inherently ambiguous.
  *
- * \todo
- * Reclaim the unused memory in the indices aray.
+ * The indices array is allocated for the worst case, where every point
+ * starts a new segment. The unused part is left in the arena.
+ *
+ * Both arrays are allocated with room for an extra linear segment, in case the
+ * path needs to be extended when normalized. See #oshu::bezier::extended.
  */
 static int parse_bezier_slider(struct parser_state *parser, oshu::hit *hit)
 {
@@ -1102,13 +1334,12 @@ static int parse_bezier_slider(struct parser_state *parser, oshu::hit *hit)
 
 	hit->slider.path.type = oshu::BEZIER_PATH;
 	oshu::bezier *bezier = &hit->slider.path.bezier;
-	bezier->control_points = (oshu::point*) calloc(count, sizeof(*bezier->control_points));
-	assert (bezier->control_points != NULL);
+	oshu::arena *arena = hit_arena(parser);
+	bezier->control_points = (oshu::point*) oshu::arena_alloc(arena, (count + 2) * sizeof(*bezier->control_points));
 	bezier->control_points[0] = hit->p;
 
 	int index = 0;
-	bezier->indices = (int*) calloc(count, sizeof(*bezier->indices));
-	assert (bezier->indices != NULL);
+	bezier->indices = (int*) oshu::arena_alloc(arena, (count + 1) * sizeof(*bezier->indices));
 	bezier->indices[index] = 0;
 
 	oshu::point prev = bezier->control_points[0];
@@ -1127,13 +1358,75 @@ static int parse_bezier_slider(struct parser_state *parser, oshu::hit *hit)
 	bezier->segment_count = index;
 	return 0;
 fail:
-	free(bezier->control_points);
 	bezier->control_points = NULL;
-	free(bezier->indices);
 	bezier->indices = NULL;
 	return -1;
 }
 
+/**
+ * Parse a Catmull slider.
+ *
+ * Consumes:
+ * `288:112|320:96|352:128`
+ *
+ * The samples are allocated by #reserve_samples once the length is known.
+ */
+static int parse_catmull_slider(struct parser_state *parser, oshu::hit *hit)
+{
+	int count = 2;
+	for (char *c = parser->input; *c != '\0' && *c != ','; ++c) {
+		if (*c == '|')
+			count++;
+	}
+
+	hit->slider.path.type = oshu::CATMULL_PATH;
+	oshu::catmull *catmull = &hit->slider.path.catmull;
+	oshu::arena *arena = hit_arena(parser);
+	catmull->point_count = count;
+	catmull->control_points = (oshu::point*) oshu::arena_alloc(arena, count * sizeof(*catmull->control_points));
+	catmull->control_points[0] = hit->p;
+	for (int i = 1; i < count; i++) {
+		if (i > 1 && consume_char(parser, '|') < 0)
+			goto fail;
+		if (parse_point(parser, &catmull->control_points[i]) < 0)
+			goto fail;
+	}
+	return 0;
+fail:
+	catmull->control_points = NULL;
+	return -1;
+}
+
+/**
+ * Allocate the polyline of a Bézier or Catmull slider whose length is known,
+ * with the room #oshu::sample_capacity asks for, so that the normalization
+ * doesn't need to allocate memory.
+ *
+ * See #oshu::bezier::samples and #oshu::catmull::samples.
+ */
+static void reserve_samples(struct parser_state *parser, oshu::hit *hit)
+{
+	oshu::path *path = &hit->slider.path;
+	int *capacity;
+	oshu::point **samples;
+	double **distances;
+	if (path->type == oshu::BEZIER_PATH) {
+		capacity = &path->bezier.sample_capacity;
+		samples = &path->bezier.samples;
+		distances = &path->bezier.distances;
+	} else if (path->type == oshu::CATMULL_PATH) {
+		capacity = &path->catmull.sample_capacity;
+		samples = &path->catmull.samples;
+		distances = &path->catmull.distances;
+	} else {
+		return;
+	}
+	oshu::arena *arena = hit_arena(parser);
+	*capacity = oshu::sample_capacity(path);
+	*samples = (oshu::point*) oshu::arena_alloc(arena, *capacity * sizeof(**samples));
+	*distances = (double*) oshu::arena_alloc(arena, *capacity * sizeof(**distances));
+}
+
 /**
  * Parse the slider-specific sound additions, right before the final and common
  * ones.
@@ -1143,8 +1436,7 @@ fail:
  */
 static int parse_slider_additions(struct parser_state *parser, oshu::hit *hit)
 {
-	hit->slider.sounds = (oshu::hit_sound*) calloc(hit->slider.repeat + 1, sizeof(*hit->slider.sounds));
-	assert (hit->slider.sounds != NULL);
+	hit->slider.sounds = (oshu::hit_sound*) oshu::arena_alloc(hit_arena(parser), (hit->slider.repeat + 1) * sizeof(*hit->slider.sounds));
 	/* Degenerate case. */
 	if (*parser->input == '\0')
 		return 0;
@@ -1176,7 +1468,6 @@ static int parse_slider_additions(struct parser_state *parser, oshu::hit *hit)
 	}
 	return 0;
 fail:
-	free(hit->slider.sounds);
 	hit->slider.sounds = NULL;
 	return -1;
 }
@@ -1273,18 +1564,234 @@ static int parse_additions(struct parser_state *parser, oshu::hit *hit)
 }
 
 
+/*****************************************************************************/
+/* Header scanner ************************************************************/
+
+/**
+ * The fields #scan_file looks for, as bit flags.
+ */
+enum scanned_field {
+	SCANNED_MODE = 0x1,
+	SCANNED_TITLE = 0x2,
+	SCANNED_ARTIST = 0x4,
+	SCANNED_VERSION = 0x8,
+	SCANNED_DIFFICULTY = 0x10,
+	SCANNED_ALL = 0x1f,
+};
+
+/**
+ * Match a `Key: value` line against *key*.
+ *
+ * Return a pointer to the value, or NULL if the line is about another key.
+ */
+static char* scan_key(char *line, const char *key)
+{
+	size_t len = strlen(key);
+	if (strncmp(line, key, len))
+		return NULL;
+	char *c = line + len;
+	while (*c == ' ' || *c == '\t')
+		++c;
+	if (*c != ':')
+		return NULL;
+	++c;
+	while (*c == ' ' || *c == '\t')
+		++c;
+	return c;
+}
+
+/**
+ * Terminate the string value starting at *value*, on the line ending at
+ * *eol*, trimming its trailing spaces like #parse_file does.
+ */
+static char* scan_string(char *value, char *eol)
+{
+	*eol = '\0';
+	for (char *c = eol; c > value && isspace(c[-1]); --c)
+		c[-1] = '\0';
+	return value;
+}
+
+/**
+ * Find the few fields a beatmap library needs in the first sections of the
+ * beatmap, without going through the parser automaton.
+ *
+ * Lines are skipped with *memchr*, and only a handful of keys are compared.
+ * The scan stops as soon as every field of #scanned_field was found, or when
+ * reaching a section where none of them may appear, which is [Events] in a
+ * well-formed beatmap.
+ *
+ * Like #parse_file, the strings are terminated in place in the input.
+ *
+ * Return 0 when the scan is over, 1 when the end of the input was reached
+ * before, and -1 when the input is not a beatmap.
+ */
+static int scan_file(char *input, size_t size, oshu::beatmap *beatmap)
+{
+	assert (input[size] == '\0');
+	char *input_end = input + size;
+
+	/* skip some binary noise on the first line, like process_header */
+	char *first_eol = (char*) memchr(input, '\n', size);
+	char *header = (char*) memchr(input, 'o', (first_eol ? first_eol : input_end) - input);
+	if (!header || strncmp(header, osu_file_header, strlen(osu_file_header)))
+		return -1;
+	char *end;
+	beatmap->version = oshu::read_integer(header + strlen(osu_file_header), &end);
+	if (end == header + strlen(osu_file_header) || beatmap->version < 0)
+		return -1;
+
+	enum beatmap_section section = BEATMAP_ROOT;
+	int found = 0;
+	char *line = header;
+	while (found != SCANNED_ALL) {
+		char *eol = (char*) memchr(line, '\n', input_end - line);
+		if (!eol)
+			eol = input_end;
+		while (*line == ' ' || *line == '\t')
+			++line;
+		char *value;
+		if (*line == '[') {
+			char *name = line + 1;
+			int len = 0;
+			while (isalpha(name[len]))
+				++len;
+			enum token token;
+			if (search_token(name, len, &token) < 0)
+				section = BEATMAP_UNKNOWN;
+			else
+				section = (enum beatmap_section) token;
+			if (section == BEATMAP_EVENTS || section == BEATMAP_TIMING_POINTS
+			    || section == BEATMAP_COLOURS || section == BEATMAP_HIT_OBJECTS)
+				return 0;
+		} else if (section == BEATMAP_GENERAL && (value = scan_key(line, "Mode"))) {
+			beatmap->mode = (oshu::mode) oshu::read_integer(value, &end);
+			found |= SCANNED_MODE;
+		} else if (section == BEATMAP_METADATA && (value = scan_key(line, "Title"))) {
+			beatmap->metadata.title = scan_string(value, eol);
+			found |= SCANNED_TITLE;
+		} else if (section == BEATMAP_METADATA && (value = scan_key(line, "Artist"))) {
+			beatmap->metadata.artist = scan_string(value, eol);
+			found |= SCANNED_ARTIST;
+		} else if (section == BEATMAP_METADATA && (value = scan_key(line, "Version"))) {
+			beatmap->metadata.version = scan_string(value, eol);
+			found |= SCANNED_VERSION;
+		} else if (section == BEATMAP_DIFFICULTY && (value = scan_key(line, "OverallDifficulty"))) {
+			beatmap->difficulty.overall_difficulty = oshu::read_decimal(value, &end);
+			found |= SCANNED_DIFFICULTY;
+		}
+		if (eol >= input_end)
+			return found == SCANNED_ALL ? 0 : 1;
+		line = eol + 1;
+	}
+	return 0;
+}
+
 /*****************************************************************************/
 /* Global interface **********************************************************/
 
 /**
- * Create the parser state, then read the input file line-by-line, feeding it
- * to the parser automaton with #process_input.
+ * Build the #oshu::beatmap::hit_index from the linked list of hits, once it is
+ * complete.
+ *
+ * The arrays are allocated from the beatmap's arena, like the hits.
+ */
+static void index_hits(oshu::beatmap *beatmap)
+{
+	oshu::hit_index *index = &beatmap->hit_index;
+	oshu::arena *arena = &beatmap->arena;
+	int size = 0;
+	for (oshu::hit *hit = beatmap->hits; hit; hit = hit->next)
+		++size;
+	index->size = size;
+	index->hits = (oshu::hit**) oshu::arena_alloc(arena, size * sizeof(*index->hits));
+	index->times = (double*) oshu::arena_alloc(arena, size * sizeof(*index->times));
+	index->end_times = (double*) oshu::arena_alloc(arena, size * sizeof(*index->end_times));
+	index->reach = (double*) oshu::arena_alloc(arena, size * sizeof(*index->reach));
+	index->points = (oshu::point*) oshu::arena_alloc(arena, size * sizeof(*index->points));
+	index->types = (int*) oshu::arena_alloc(arena, size * sizeof(*index->types));
+	index->states = (enum oshu::hit_state*) oshu::arena_alloc(arena, size * sizeof(*index->states));
+	double reach = -INFINITY;
+	int i = 0;
+	for (oshu::hit *hit = beatmap->hits; hit; hit = hit->next, ++i) {
+		hit->index = i;
+		index->hits[i] = hit;
+		index->times[i] = hit->time;
+		index->end_times[i] = oshu::hit_end_time(hit);
+		if (index->end_times[i] > reach)
+			reach = index->end_times[i];
+		index->reach[i] = reach;
+		index->points[i] = hit->p;
+		index->types[i] = hit->type;
+		index->states[i] = hit->state;
+	}
+}
+
+/**
+ * Terminate the line going from *line* to *eol* in place, trim it, and feed
+ * it to the parser automaton with #process_input.
+ *
+ * *eol* is where the line feed is, or the end of the input, and is overwritten
+ * with a null byte.
+ *
+ * Return -1 if the beatmap header is invalid, which makes the rest of the
+ * input pointless. Errors on single lines are ignored.
+ */
+static int process_line(struct parser_state *parser, char *line, char *eol)
+{
+	*eol = '\0';
+	for (char *c = eol; c > line && isspace(c[-1]); --c)
+		c[-1] = '\0';
+	parser->buffer = line;
+	parser->input = line;
+	parser->line_number++;
+	try {
+		process_input(parser);
+	} catch (invalid_header& e) {
+		oshu::error_log() << e.what() << std::endl;
+		return -1;
+	}
+	/* ^ note: ignore parsing errors */
+	return 0;
+}
+
+/**
+ * Append the final unreachable hit object, and index the beatmap.
+ */
+static void finish_parsing(struct parser_state *parser)
+{
+	oshu::beatmap *beatmap = parser->beatmap;
+	oshu::hit *end;
+	if (discarding_hits(parser)) {
+		/* forget the hits, which are gone with the scratch arenas */
+		parser->last_hit = beatmap->hits;
+		end = (oshu::hit*) oshu::arena_alloc(&beatmap->arena, sizeof(*end));
+	} else {
+		end = allocate_hit(parser);
+	}
+	end->time = INFINITY;
+	parser->last_hit->next = end;
+	end->previous = parser->last_hit;
+	index_timing_points(beatmap);
+	index_hits(beatmap);
+}
+
+/**
+ * Create the parser state, then split the input buffer into lines, feeding
+ * them to the parser automaton with #process_line.
+ *
+ * The buffer is modified in place: the trailing spaces of every line, along
+ * with its line feed, are replaced with null bytes. This is how the strings
+ * the beatmap keeps get terminated without being copied.
+ *
+ * The byte at `input[size]` must exist and be null, so that the last line is
+ * terminated even when it doesn't end with a line feed.
  *
  * \todo
  * Stop reading the file if the header is incorrect. It's no use printing a
  * mega list of warnings if the file clearly looks nothing like text.
  */
-static int parse_file(FILE *input, const char *name, oshu::beatmap *beatmap, bool headers_only)
+static int parse_file(char *input, size_t size, const char *name, oshu::beatmap *beatmap, bool headers_only)
 {
 	struct parser_state parser;
 	memset(&parser, 0, sizeof(parser));
@@ -1293,34 +1800,24 @@ static int parse_file(FILE *input, const char *name, oshu::beatmap *beatmap, boo
 	parser.beatmap = beatmap;
 	parser.last_hit = beatmap->hits;
 	int rc = 0;
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t nread;
-	while ((nread = getline(&line, &len, input)) != -1) {
-		for (int i = nread - 1; i >= 0 && isspace(line[i]); --i)
-			line[i] = '\0';
-		parser.buffer = line;
-		parser.input = line;
-		parser.line_number++;
-		try {
-			process_input(&parser);
-		} catch (invalid_header& e) {
-			oshu::error_log() << e.what() << std::endl;
+	assert (input[size] == '\0');
+	char *input_end = input + size;
+	parser.input_end = input_end;
+	for (char *line = input; line < input_end;) {
+		char *eol = (char*) memchr(line, '\n', input_end - line);
+		if (!eol)
+			eol = input_end;
+		char *next = eol < input_end ? eol + 1 : input_end;
+		parser.next_line = next;
+		if (process_line(&parser, line, eol) < 0) {
 			rc = -1;
 			break;
 		}
-		/* ^ note: ignore parsing errors */
+		line = next;
 		if (headers_only && parser.section == BEATMAP_TIMING_POINTS)
 			break;
 	}
-	free(line);
-	/* Finalize the hits sequence. */
-	oshu::hit *end;
-	end = (oshu::hit*) calloc(1, sizeof(*end));
-	assert (end != NULL);
-	end->time = INFINITY;
-	parser.last_hit->next = end;
-	end->previous = parser.last_hit;
+	finish_parsing(&parser);
 	return rc;
 }
 
@@ -1331,8 +1828,7 @@ static int parse_file(FILE *input, const char *name, oshu::beatmap *beatmap, boo
 void initialize(oshu::beatmap *beatmap)
 {
 	memcpy(beatmap, &default_beatmap, sizeof(*beatmap));
-	beatmap->hits = (oshu::hit*) calloc(1, sizeof(*beatmap->hits));
-	assert (beatmap->hits != NULL);
+	beatmap->hits = (oshu::hit*) oshu::arena_alloc(&beatmap->arena, sizeof(*beatmap->hits));
 	beatmap->hits->time = -INFINITY;
 }
 
@@ -1364,29 +1860,83 @@ static int validate(oshu::beatmap *beatmap)
 	return 0;
 }
 
-static int load_beatmap(const char *path, oshu::beatmap *beatmap, bool headers_only)
+/**
+ * Map the file privately in memory, with a null byte right after its end.
+ *
+ * The mapping is writable so that the parser may terminate its lines in place,
+ * but being private, the changes never reach the file and only the touched
+ * pages get copied.
+ *
+ * An anonymous region one byte larger than the file is reserved first, then
+ * the file is mapped over it. This guarantees the byte following the end of
+ * the file exists and is zero, even when the size of the file is a multiple of
+ * the page size.
+ *
+ * The mapping is stored in #oshu::beatmap::mapping.
+ */
+static int map_beatmap(int fd, size_t size, oshu::beatmap *beatmap)
+{
+	void *region = mmap(NULL, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		oshu_log_error("could not reserve memory for the beatmap: %s", strerror(errno));
+		return -1;
+	}
+	if (size > 0 && mmap(region, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		oshu_log_error("could not map the beatmap: %s", strerror(errno));
+		munmap(region, size + 1);
+		return -1;
+	}
+	madvise(region, size, MADV_SEQUENTIAL);
+	beatmap->mapping = (char*) region;
+	beatmap->mapping_size = size;
+	return 0;
+}
 
+/**
+ * Open a beatmap file for reading, and stat it.
+ *
+ * Return the file descriptor, or -1 on error.
+ */
+static int open_beatmap(const char *path, struct stat *s)
 {
-	oshu_log_debug("loading beatmap %s", path);
-	struct stat s;
-	if (stat(path, &s) < 0) {
-		oshu_log_error("could not find the beatmap: %s", strerror(errno));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		oshu_log_error("could not open the beatmap: %s", strerror(errno));
 		return -1;
 	}
-	if (!(S_ISREG(s.st_mode) || S_ISLNK(s.st_mode))) {
+	if (fstat(fd, s) < 0) {
+		oshu_log_error("could not stat the beatmap: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(s->st_mode)) {
 		oshu_log_error("not a file: %s", path);
+		close(fd);
 		return -1;
 	}
-	FILE *input = fopen(path, "r");
-	if (input == NULL) {
-		oshu_log_error("could not open the beatmap: %s", strerror(errno));
+	return fd;
+}
+
+static int load_beatmap(const char *path, oshu::beatmap *beatmap, bool headers_only)
+{
+	oshu_log_debug("loading beatmap %s", path);
+	struct stat s;
+	int fd = open_beatmap(path, &s);
+	if (fd < 0)
 		return -1;
+	if (!headers_only && oshu::load_beatmap_cache(path, &s, beatmap) == 0) {
+		close(fd);
+		index_timing_points(beatmap);
+		index_hits(beatmap);
+		return 0;
 	}
 	initialize(beatmap);
-	int rc = parse_file(input, path, beatmap, headers_only);
-	fclose(input);
+	int rc = map_beatmap(fd, s.st_size, beatmap);
+	close(fd);
 	if (rc < 0)
 		goto fail;
+	if (parse_file(beatmap->mapping, beatmap->mapping_size, path, beatmap, headers_only) < 0)
+		goto fail;
 	if (validate(beatmap) < 0)
 		goto fail;
 	return 0;
@@ -1396,6 +1946,94 @@ fail:
 	return -1;
 }
 
+/**
+ * Size of the beginning of a beatmap #oshu::scan_beatmap reads at first.
+ *
+ * The fields it looks for are in the first sections, which fit in a few KiB
+ * unless the beatmap has unusually long tags or comments.
+ */
+static const size_t scan_window = 8 * 1024;
+
+/**
+ * Read the first *size* bytes of a file, or less if the file is shorter.
+ *
+ * Return the number of bytes read, or -1 on error.
+ */
+static ssize_t read_beginning(int fd, char *buffer, size_t size)
+{
+	size_t total = 0;
+	while (total < size) {
+		ssize_t rc = pread(fd, buffer + total, size - total, total);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0)
+			return -1;
+		if (rc == 0)
+			break;
+		total += rc;
+	}
+	return total;
+}
+
+/**
+ * Scan the beginning of the file with #scan_file, reading only #scan_window
+ * bytes at first, and reading a bigger window from the start whenever the
+ * fields weren't all found in the current one.
+ *
+ * When the window ends in the middle of the file, it is cut after its last
+ * complete line, so that no field is read truncated.
+ *
+ * The windows are allocated from the beatmap's arena, as the strings point
+ * inside them.
+ */
+static int scan_beginning(int fd, size_t file_size, oshu::beatmap *beatmap)
+{
+	for (size_t window = scan_window;; window *= 4) {
+		if (window > file_size)
+			window = file_size;
+		char *input = (char*) oshu::arena_alloc(&beatmap->arena, window + 1);
+		ssize_t size = read_beginning(fd, input, window);
+		if (size < 0) {
+			oshu_log_error("could not read the beatmap: %s", strerror(errno));
+			return -1;
+		}
+		bool partial = (size_t) size == window && window < file_size;
+		if (partial) {
+			char *last_line = (char*) memrchr(input, '\n', size);
+			if (!last_line)
+				continue;
+			size = last_line + 1 - input;
+			input[size] = '\0';
+		}
+		int rc = scan_file(input, size, beatmap);
+		if (rc <= 0 || !partial)
+			return rc < 0 ? -1 : 0;
+	}
+}
+
+int oshu::scan_beatmap(const char *path, oshu::beatmap *beatmap)
+{
+	struct stat s;
+	int fd = open_beatmap(path, &s);
+	if (fd < 0)
+		return -1;
+	memcpy(beatmap, &default_beatmap, sizeof(*beatmap));
+	int rc = scan_beginning(fd, s.st_size, beatmap);
+	close(fd);
+	if (rc < 0) {
+		oshu_log_error("%s: invalid osu beatmap header", path);
+		goto fail;
+	}
+	if (validate_metadata(&beatmap->metadata) < 0) {
+		oshu_log_error("%s: incomplete metadata", path);
+		goto fail;
+	}
+	return 0;
+fail:
+	oshu::destroy_beatmap(beatmap);
+	return -1;
+}
+
 int oshu::load_beatmap(const char *path, oshu::beatmap *beatmap)
 {
 	return ::load_beatmap(path, beatmap, false);
@@ -1406,68 +2044,175 @@ int oshu::load_beatmap_headers(const char *path, oshu::beatmap *beatmap)
 	return ::load_beatmap(path, beatmap, true);
 }
 
-static void free_metadata(oshu::metadata *meta)
+void oshu::cache_beatmap(const char *path, oshu::beatmap *beatmap)
 {
-	free(meta->title);
-	free(meta->title_unicode);
-	free(meta->artist);
-	free(meta->artist_unicode);
-	free(meta->creator);
-	free(meta->version);
-	free(meta->source);
+	if (!beatmap->mapping)
+		return;
+	struct stat s;
+	if (stat(path, &s) < 0 || (size_t) s.st_size != beatmap->mapping_size)
+		return;
+	oshu::save_beatmap_cache(path, &s, beatmap);
 }
 
-static void free_path(oshu::path *path)
+static int parse_buffer(const char *buffer, size_t size, oshu::beatmap *beatmap, bool headers_only)
 {
-	if (path->type == oshu::BEZIER_PATH) {
-		free(path->bezier.control_points);
-		free(path->bezier.indices);
+	initialize(beatmap);
+	char *input = (char*) oshu::arena_alloc(&beatmap->arena, size + 1);
+	memcpy(input, buffer, size);
+	if (parse_file(input, size, "<buffer>", beatmap, headers_only) < 0)
+		goto fail;
+	if (validate(beatmap) < 0)
+		goto fail;
+	return 0;
+fail:
+	oshu_log_error("error parsing the beatmap buffer");
+	oshu::destroy_beatmap(beatmap);
+	return -1;
+}
+
+int oshu::parse_beatmap(const char *buffer, size_t size, oshu::beatmap *beatmap)
+{
+	return parse_buffer(buffer, size, beatmap, false);
+}
+
+int oshu::parse_beatmap_headers(const char *buffer, size_t size, oshu::beatmap *beatmap)
+{
+	return parse_buffer(buffer, size, beatmap, true);
+}
+
+/* Streaming ******************************************************************/
+
+struct oshu::beatmap_stream {
+	struct parser_state parser;
+	/**
+	 * Input received but not parsed yet, because its last line is
+	 * incomplete.
+	 */
+	std::vector<char> pending;
+	/**
+	 * Set when the header is found invalid.
+	 */
+	bool failed;
+};
+
+/**
+ * Tell whether the strings found in the current section are kept in the
+ * beatmap.
+ *
+ * Only the last three sections, which are also the biggest, have none.
+ */
+static bool keeps_strings(struct parser_state *parser)
+{
+	switch (parser->section) {
+	case BEATMAP_TIMING_POINTS:
+	case BEATMAP_COLOURS:
+	case BEATMAP_HIT_OBJECTS:
+		return false;
+	default:
+		return true;
 	}
 }
 
-static void free_hits(oshu::hit *hits)
+/**
+ * Parse the line from *line* to *eol*, inside the pending buffer.
+ *
+ * When the section may keep strings from it, the line is copied into the
+ * beatmap's arena first, since the pending buffer is reused for the next
+ * chunks.
+ */
+static int process_stream_line(oshu::beatmap_stream *stream, char *line, char *eol)
 {
-	oshu::hit *current = hits;
-	while (current != NULL) {
-		oshu::hit *next = current->next;
-		if (current->type & oshu::SLIDER_HIT) {
-			free_path(&current->slider.path);
-			free(current->slider.sounds);
-		}
-		free(current);
-		current = next;
+	struct parser_state *parser = &stream->parser;
+	if (keeps_strings(parser)) {
+		size_t length = eol - line;
+		char *copy = (char*) oshu::arena_alloc(&parser->beatmap->arena, length + 1);
+		memcpy(copy, line, length);
+		line = copy;
+		eol = copy + length;
 	}
+	return process_line(parser, line, eol);
+}
+
+oshu::beatmap_stream* oshu::open_beatmap_stream(oshu::beatmap *beatmap, oshu::beatmap_listener *listener)
+{
+	initialize(beatmap);
+	oshu::beatmap_stream *stream = new oshu::beatmap_stream;
+	memset(&stream->parser, 0, sizeof(stream->parser));
+	stream->parser.section = BEATMAP_HEADER;
+	stream->parser.source = "<stream>";
+	stream->parser.beatmap = beatmap;
+	stream->parser.last_hit = beatmap->hits;
+	stream->parser.listener = listener;
+	stream->failed = false;
+	return stream;
 }
 
-static void free_timing_points(oshu::timing_point *t)
+/**
+ * Every complete line of the pending buffer is parsed, then removed from the
+ * buffer, which leaves only the beginning of the next line.
+ *
+ * The parser may look past the current line, to estimate the number of hit
+ * objects for example, so it is told the pending buffer ends the input.
+ */
+int oshu::feed_beatmap_stream(oshu::beatmap_stream *stream, const char *data, size_t size)
 {
-	oshu::timing_point *current = t;
-	while (current != NULL) {
-		oshu::timing_point *next = current->next;
-		free(current);
-		current = next;
+	if (stream->failed)
+		return -1;
+	stream->pending.insert(stream->pending.end(), data, data + size);
+	char *begin = stream->pending.data();
+	char *end = begin + stream->pending.size();
+	stream->parser.input_end = end;
+	char *line = begin;
+	while (line < end) {
+		char *eol = (char*) memchr(line, '\n', end - line);
+		if (!eol)
+			break;
+		stream->parser.next_line = eol + 1;
+		if (process_stream_line(stream, line, eol) < 0) {
+			stream->failed = true;
+			return -1;
+		}
+		line = eol + 1;
 	}
+	stream->pending.erase(stream->pending.begin(), stream->pending.begin() + (line - begin));
+	return 0;
 }
 
-static void free_colors(oshu::color *colors)
+int oshu::close_beatmap_stream(oshu::beatmap_stream *stream)
 {
-	if (!colors)
-		return;
-	oshu::color *current = colors;
-	do {
-		oshu::color *next = current->next;
-		free(current);
-		current = next;
-	} while (current != colors);
+	struct parser_state *parser = &stream->parser;
+	oshu::beatmap *beatmap = parser->beatmap;
+	int rc = stream->failed ? -1 : 0;
+	if (rc == 0 && !stream->pending.empty()) {
+		/* the last line, without line feed */
+		stream->pending.push_back('\0');
+		char *line = stream->pending.data();
+		char *eol = line + stream->pending.size() - 1;
+		parser->input_end = eol;
+		parser->next_line = eol;
+		rc = process_stream_line(stream, line, eol);
+	}
+	if (parser->listener && parser->section >= 0)
+		parser->listener->section(*beatmap, token_strings[parser->section]);
+	finish_parsing(parser);
+	oshu::destroy_arena(&parser->scratch[0]);
+	oshu::destroy_arena(&parser->scratch[1]);
+	delete stream;
+	if (rc == 0)
+		rc = validate(beatmap);
+	if (rc < 0) {
+		oshu_log_error("error parsing the beatmap stream");
+		oshu::destroy_beatmap(beatmap);
+		return -1;
+	}
+	return 0;
 }
 
 void oshu::destroy_beatmap(oshu::beatmap *beatmap)
 {
-	free(beatmap->audio_filename);
-	free(beatmap->background_filename);
-	free_metadata(&beatmap->metadata);
-	free_timing_points(beatmap->timing_points);
-	free_colors(beatmap->colors);
-	free_hits(beatmap->hits);
+	oshu::cancel_path_prefetch(beatmap);
+	oshu::destroy_arena(&beatmap->arena);
+	if (beatmap->mapping)
+		munmap(beatmap->mapping, beatmap->mapping_size + 1);
 	memset(beatmap, 0, sizeof(*beatmap));
 }
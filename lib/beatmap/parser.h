@@ -42,28 +42,17 @@
  *
  * ### SAX-like parser
  *
- * Rather than hiding the parser, it could be exposed and configurable through
- * a callback interface with virtual methods.
+ * The parser may report its progress through the #oshu::beatmap_listener
+ * interface, as lines are fed to it with #oshu::feed_beatmap_stream. The
+ * listener sees the sections, timing points and hit objects as they complete,
+ * without waiting for the end of the input.
  *
- * ```c
- * struct builder {
- * 	virtual void title(const std::string&) {}
- * 	virtual void timing_point(const timing_point_record&) {}
- * 	virtual void color(struct color&) {}
- * 	virtual void hit_object(const hit_object_record&) {}
- * };
- * ```
- *
- * With that kind of parser, it's easy to build a fast parser that, say, only
- * stores the metadata. No need to store the whole beatmap in the memory
- * everytime or make special cases in the parser.
- *
- * The main advantage is that the parsing and interpretation are separated,
- * isolating these two complex logics. The performance cost doesn't sound too
- * heavy.
+ * The objects are still built by the parser though, so the parsing and the
+ * interpretation are not separated yet.
  *
  * \todo
- * Build the SAX-like parser.
+ * Let the listener build the objects, so that, say, a metadata-only parser
+ * doesn't need special cases in the parser.
  *
  */
 
@@ -78,7 +67,7 @@
  *
  * Using such a structure makes it easier, and also faster, to branch on
  * sections or keys. The #parse_token function also optimizes the performance
- * by performing a dichotomic search.
+ * by looking the token up in a perfect hash table.
  *
  * Since we're in an internal header, let's break the naming a bit and use the
  * same strings as the ones in the beatmap, with the same case.
@@ -182,15 +171,6 @@ struct parser_state {
 	 * Keep track of the last color to build the circular linked list.
 	 */
 	oshu::color *last_color;
-	/**
-	 * When parsing hit objects, we need to figure out what its timing
-	 * point is, notably to compute slider durations.
-	 *
-	 * It is NULL until the first hit object is parsed, and keeps increasing.
-	 * It must not become NULL at the end of the chain, because otherwise
-	 * we're back to the first case and will trigger an infinite loop.
-	 */
-	oshu::timing_point *current_timing_point;
 	/**
 	 * This is the #oshu::timing_point::beat_duration of the last
 	 * non-inherited timing point.
@@ -200,6 +180,53 @@ struct parser_state {
 	 * Keep track of the last hit object to build the linked list.
 	 */
 	oshu::hit *last_hit;
+	/**
+	 * Beginning of the line following the current one.
+	 *
+	 * Together with #input_end, it delimits the part of the input the
+	 * parser hasn't seen yet.
+	 */
+	char *next_line;
+	/**
+	 * End of the whole input buffer.
+	 */
+	char *input_end;
+	/**
+	 * Array of hit objects reserved from the beatmap's arena when entering
+	 * the [HitObjects] section.
+	 *
+	 * It has one slot per remaining line in the input, which is an upper
+	 * bound for the number of hit objects. #process_hit_object fills it
+	 * in order, making the hits contiguous in memory.
+	 */
+	oshu::hit *hit_table;
+	/**
+	 * Number of slots in #hit_table.
+	 */
+	int hit_capacity;
+	/**
+	 * Number of slots of #hit_table already used.
+	 */
+	int hit_count;
+	/**
+	 * Receives the objects as they are parsed, when parsing a stream.
+	 *
+	 * NULL otherwise.
+	 */
+	oshu::beatmap_listener *listener;
+	/**
+	 * When the #listener doesn't keep the hit objects, they are allocated
+	 * from these two arenas in turn instead of the beatmap's.
+	 *
+	 * The previous hit object is needed to parse the next one, for its
+	 * combo and time. Once the next one is parsed, the arena of the
+	 * previous one is cleared for the one after.
+	 */
+	oshu::arena scratch[2];
+	/**
+	 * Index of the #scratch arena the next hit object is allocated from.
+	 */
+	int scratch_index;
 };
 
 /**
@@ -250,6 +277,7 @@ static int process_input(P*);
 		static int parse_color_channel(P*, double*);
 		static void validate_colors(P*);
 	static int process_hit_object(P*);
+		static void reserve_hits(P*);
 		static int parse_hit_object(P*, oshu::hit**);
 			static int parse_common_hit(P*, oshu::hit*);
 			static int parse_slider(P*, oshu::hit*);
@@ -257,6 +285,9 @@ static int process_input(P*);
 				static int parse_linear_slider(P*, oshu::hit*);
 				static int parse_perfect_slider(P*, oshu::hit*);
 				static int parse_bezier_slider(P*, oshu::hit*);
+				static int parse_catmull_slider(P*, oshu::hit*);
+				static void reserve_samples(P*, oshu::hit*);
+				static void time_slider(P*, oshu::hit*);
 				static int parse_slider_additions(P*, oshu::hit*);
 			static int parse_spinner(P*, oshu::hit*);
 			static int parse_hold_note(P*, oshu::hit*);
@@ -9,6 +9,8 @@
 
 #include <assert.h>
 
+#include <thread>
+
 /**
  * When we get a value under this in our computation, we'll assume the value is
  * almost 0 and possibly trigger an error, depending on the context.
@@ -110,20 +112,30 @@ static void bezier_map(oshu::bezier *path, double *t, int *degree, oshu::point *
 }
 
 /**
- * Compute the position of a point expressed in *t*-coordinates.
+ * Compute the point at *t* of a single Bézier segment of degree *degree*.
  *
- * The coordinates are mapped with #bezier_map, and then we just apply the
- * standard explicit definition of Bézier curves.
+ * The linear, quadratic and cubic segments, which make most of the
+ * beatmaps, are computed from their Bernstein polynomials directly.
  *
- * Use de Casteljau's algorithm for numerical stability. I did come across
- * super high-degree Bézier curves on some beatmaps, and the factorial was at
- * its limits.
+ * For the other ones, use de Casteljau's algorithm for numerical stability.
+ * I did come across super high-degree Bézier curves on some beatmaps, and the
+ * factorial was at its limits.
  */
-static oshu::point bezier_at(oshu::bezier *path, double t)
+static oshu::point segment_at(oshu::point *points, int degree, double t)
 {
-	int degree;
-	oshu::point *points;
-	bezier_map(path, &t, &degree, &points);
+	double u = 1. - t;
+	switch (degree) {
+	case 0:
+		return points[0];
+	case 1:
+		return u * points[0] + t * points[1];
+	case 2:
+		return u * u * points[0] + 2. * u * t * points[1] + t * t * points[2];
+	case 3:
+		return u * u * u * points[0] + 3. * u * u * t * points[1]
+		       + 3. * u * t * t * points[2] + t * t * t * points[3];
+	}
+
 	oshu::point pp[degree + 1];
 	memcpy(pp, points, (degree + 1) * sizeof(*pp));
 
@@ -132,11 +144,25 @@ static oshu::point bezier_at(oshu::bezier *path, double t)
 	 * iteration. We stop when only 1 point is left */
 	for (int l = (degree + 1); l > 1; --l) {
 		for (int j = 0; j < (l - 1); ++j)
-			pp[j] = (1. - t) * pp[j] + t * pp[j+1];
+			pp[j] = u * pp[j] + t * pp[j+1];
 	}
 	return pp[0];
 }
 
+/**
+ * Compute the position of a point expressed in *t*-coordinates.
+ *
+ * The coordinates are mapped with #bezier_map, and then we just apply the
+ * standard explicit definition of Bézier curves with #segment_at.
+ */
+static oshu::point bezier_at(oshu::bezier *path, double t)
+{
+	int degree;
+	oshu::point *points;
+	bezier_map(path, &t, &degree, &points);
+	return segment_at(points, degree, t);
+}
+
 /**
  * Grow a Bézier path.
  *
@@ -150,8 +176,9 @@ static oshu::point bezier_at(oshu::bezier *path, double t)
  * equal to the *extension* argument, and finally adding that vector to the
  * previous point.
  *
- * The memory reallocation implies the memory must have been dynamically
- * allocated. You won't be able to grow a static path.
+ * The parser reserved room for that segment in the arrays, so that no memory
+ * needs to be allocated here. When the path was already extended, its extra
+ * segment is made longer instead.
  */
 static int grow_bezier(oshu::bezier *bezier, double extension)
 {
@@ -170,120 +197,248 @@ static int grow_bezier(oshu::bezier *bezier, double extension)
 		return -1;
 	}
 
+	oshu::vector step = direction / std::abs(direction) * extension;
+	if (bezier->extended) {
+		bezier->control_points[n - 1] = end + step;
+		return 0;
+	}
+
 	bezier->segment_count++;
-	bezier->indices = (int*) realloc(bezier->indices, (bezier->segment_count + 1) * sizeof(*bezier->indices));
 	bezier->indices[bezier->segment_count] = n + 2;
-
-	bezier->control_points = (oshu::point*) realloc(bezier->control_points, (n + 2) * sizeof(*bezier->control_points));
 	bezier->control_points[n] = end;
-	bezier->control_points[n + 1] = end + direction / std::abs(direction) * extension;
+	bezier->control_points[n + 1] = end + step;
+	bezier->extended = true;
 	return 0;
 }
 
+/**
+ * Error tolerance of #flatten, in osu!pixels, unless the points don't fit in
+ * #oshu::bezier::sample_capacity.
+ */
+static const double flatness = .05;
+
+/**
+ * Maximum number of points #normalize_bezier uses to measure a path.
+ */
+static const int max_flat_points = 2048;
+
+/**
+ * Points picked on a Bézier path to measure it, with their t-coordinates and
+ * their L-coordinates, that is their distance from the beginning of the path
+ * along the polyline.
+ */
+struct flattening {
+	int count;
+	/**
+	 * How many more pieces may be split, such that the points will
+	 * always fit in the arrays.
+	 */
+	int budget;
+	/**
+	 * How far from the curve the polyline may go, in osu!pixels.
+	 */
+	double tolerance;
+	double t[max_flat_points];
+	double L[max_flat_points];
+	oshu::point p[max_flat_points];
+};
+
+/**
+ * Append the piece of path between *t0* and *t1* to *flat*, splitting it in
+ * halves until each part is flat.
+ *
+ * A piece is flat when its middle point is within the tolerance of the middle
+ * of the chord. This bounds how far the chord goes from the curve, and also
+ * splits the pieces whose speed varies a lot, like the ones around a cusp,
+ * which a mere distance to the chord would miss. When the budget is
+ * exhausted, the pieces are taken as they are.
+ *
+ * *p0* and *p1* are the points at *t0* and *t1*, and the point at *t0* must be
+ * the last one of *flat*.
+ */
+static void flatten(oshu::bezier *bezier, double t0, oshu::point p0, double t1, oshu::point p1, struct flattening *flat)
+{
+	double chord = std::abs(p1 - p0);
+	if (flat->budget > 0) {
+		double tm = (t0 + t1) / 2.;
+		oshu::point pm = bezier_at(bezier, tm);
+		if (std::abs(pm - (p0 + p1) / 2.) > flat->tolerance) {
+			flat->budget--;
+			flatten(bezier, t0, p0, tm, pm, flat);
+			flatten(bezier, tm, pm, t1, p1, flat);
+			return;
+		}
+	}
+	assert (flat->count < max_flat_points);
+	flat->t[flat->count] = t1;
+	flat->L[flat->count] = flat->L[flat->count - 1] + chord;
+	flat->p[flat->count] = p1;
+	flat->count++;
+}
+
+/**
+ * Pick points on the curve with #flatten, starting from 4 evenly spaced
+ * pieces per segment. Because the segments have the same share of the t
+ * range, every joint between two segments is one of the points.
+ */
+static void measure_bezier(oshu::bezier *bezier, double tolerance, struct flattening *flat)
+{
+	int pieces = 4 * bezier->segment_count;
+	if (pieces > max_flat_points - 1)
+		pieces = max_flat_points - 1;
+	flat->count = 1;
+	flat->budget = max_flat_points - 1 - pieces;
+	flat->tolerance = tolerance;
+	flat->t[0] = 0;
+	flat->L[0] = 0;
+	flat->p[0] = bezier->control_points[0];
+	for (int i = 1; i <= pieces; i++) {
+		double t = (double) i / pieces;
+		flatten(bezier, flat->t[flat->count - 1], flat->p[flat->count - 1], t, bezier_at(bezier, t), flat);
+	}
+}
+
+/**
+ * Count the points of *flat* before the L-coordinate *length*, which is where
+ * the path is cut.
+ */
+static int cut_index(const struct flattening *flat, double length)
+{
+	int i = 1;
+	while (i < flat->count - 1 && flat->L[i] < length)
+		i++;
+	return i;
+}
+
+/**
+ * Compute the #oshu::bezier::distances of a polyline.
+ */
+static void measure_polyline(const oshu::point *points, int count, double *distances)
+{
+	distances[0] = 0;
+	for (int i = 1; i < count; ++i)
+		distances[i] = distances[i - 1] + std::abs(points[i] - points[i - 1]);
+	double length = distances[count - 1];
+	for (int i = 1; i < count; ++i)
+		distances[i] = length > epsilon ? distances[i] / length : (double) i / (count - 1);
+}
+
 /**
  * Approximate the length of the segment and set-up the l-coordinate system.
  *
  * Receives a Bézier path whose #oshu::bezier::segment_count,
  * #oshu::bezier::indices and #oshu::bezier::control_points are filled, and use
- * these data to compute the #oshu::bezier::anchors field.
+ * these data to compute the #oshu::bezier::samples field.
  *
  * Here are the steps of the normalization process:
  *
- * 1. Pick `n + 1` points `p_0, …, p_n` on the curve, with their t-coordinates
+ * 1. Pick points `p_0, …, p_n` on the curve, with their t-coordinates
  *    `t_0, … t_n` such that `t_0 = 0`, `t_n = 1`, and for every i ≤ j,
- *    `t_i ≤ t_j`. The sanest choice is to take `t_i = i / n`.
+ *    `t_i ≤ t_j`. We start with 4 evenly spaced pieces per segment, and
+ *    split them with #flatten until the polyline is within #flatness of the
+ *    curve. The straight parts get few points, and the tight curves many.
  *
  * 2. For each point, compute its distance from the beginning, following the
  *    curve. `L_0 = 0` and `L_(i+1) = L_i + || p_(i+1) - p_i ||`.
  *    With this, `L_n` is the actual length of the path.
  *
- * 3. Deduce the l-coordinates of the points by normalizing the L-coordinates
- *    above such that `l_0 = 0` and `l_n = 1`: let `l_i = L_i / L`. Note that
- *    here, `L` is the *wanted* length, assuming `L ≤ L_n`. This implies
- *    `l_n ≥ 1`, which in turns implies that the final curve is cut, the
- *    desired effect.
+ * 3. Let `L` be the *wanted* length, assuming `L ≤ L_n`. The part of the
+ *    curve past `L` is cut, which is the desired effect.
+ *
+ * 4. The points before `L` are the samples, followed by the point at `L`.
+ *    Find `i` such that `L_i < L ≤ L_(i+1)`, compute `k` such that
+ *    `L = (1-k) * L_i + k * L_(i+1)`, and take `(1-k) * p_i + k * p_(i+1)`.
+ *    The polyline is then exactly `L` long.
+ *
+ * 5. Compute the #oshu::bezier::distances of the samples.
  *
- * 4. Now, let's compute #oshu::bezier::anchors.
- *    For every anchor index `j`, let `l = j / (# of anchors - 1)`, and find
- *    `i` such that `l_i ≤ l ≤ l_(i+1)`.
- *    Compute `k` such that `l = (1-k) * l_i + k * l_(i+1)`.
- *    Hint: `k = (l - l_i) / (l_(i+1) - l_i)`.
- *    Finally, let `anchors[j] = (1-k) * t_i + k * t_(i+1)`.
+ * Measuring the path with a fixed number of points was too coarse for the
+ * long sliders, whose ball would visibly change speed, and wasteful for the
+ * short ones.
  *
+ * When the samples don't fit in #oshu::bezier::sample_capacity, the path is
+ * measured again with a larger tolerance. Resampling the points evenly
+ * instead would cut the sharp corners at the joints of the segments, making
+ * the path visibly shorter.
  */
 void normalize_bezier(oshu::bezier *bezier, double target_length)
 {
-	/* 1. Prepare the field. */
-	int n = 64;  /* arbitrary */
-	double l[n + 1];
+	struct flattening flat;
+	double tolerance = flatness;
 	double length;
-
-begin:
-	/* 2. Compute the length of the path. */
-	length = 0;
-	oshu::point prev = bezier->control_points[0];
-	for (int i = 0; i <= n; i++) {
-		double t = (double) i / n;
-		oshu::point current = bezier_at(bezier, t);
-		length += std::abs(prev - current);
-		l[i] = length;
-		prev = current;
+	int cut;
+
+	/* 1. and 2. Measure the path. */
+	measure_bezier(bezier, tolerance, &flat);
+	length = flat.L[flat.count - 1];
+	if (length + 5. < target_length && grow_bezier(bezier, target_length - length) >= 0) {
+		measure_bezier(bezier, tolerance, &flat);
+		length = flat.L[flat.count - 1];
 	}
-	if (length + 5. < target_length) {
-		if (grow_bezier(bezier, target_length - length) >= 0)
-			goto begin;
-	}
-	if (length < target_length)
-		/* ignore the rounding errors */
-		target_length = length;
 
-	/* 3. Deduce the l-coordinates. */
-	assert (length > 0);
-	for (int i = 0; i <= n; i++)
-		l[i] /= target_length;
-
-	/* 4. Set up the anchors. */
-	int i = 0;
-	int num_anchors = sizeof(bezier->anchors) / sizeof(*bezier->anchors);
-	for (int j = 0; j < num_anchors; j++) {
-		double my_l = (double) j / (num_anchors - 1);
-		while (!(my_l <= l[i + 1]) && i < n - 1)
-			i++;
-		assert (l[i] <= my_l);
-		double k = (my_l - l[i]) / (l[i+1] - l[i]);
-		bezier->anchors[j] = (1. - k) * i / n + k * (i + 1.) / n;
+	/* 3. Cut the path. */
+	for (;;) {
+		if (length < target_length)
+			/* ignore the rounding errors */
+			target_length = length;
+		cut = cut_index(&flat, target_length);
+		/* at worst, the initial pieces fit, see oshu::sample_capacity */
+		if (cut + 1 <= bezier->sample_capacity)
+			break;
+		tolerance *= 4.;
+		measure_bezier(bezier, tolerance, &flat);
+		length = flat.L[flat.count - 1];
 	}
+	assert (length > 0);
+
+	/* 4. Sample the path. */
+	for (int j = 0; j < cut; j++)
+		bezier->samples[j] = flat.p[j];
+	double span = flat.L[cut] - flat.L[cut - 1];
+	double k = span < epsilon ? 1. : (target_length - flat.L[cut - 1]) / span;
+	if (k > 1.)
+		k = 1.;
+	bezier->samples[cut] = (1. - k) * flat.p[cut - 1] + k * flat.p[cut];
+	bezier->sample_count = cut + 1;
+
+	/* 5. */
+	measure_polyline(bezier->samples, bezier->sample_count, bezier->distances);
 }
 
+/* Polylines ******************************************************************/
+
 /**
- * Translate l-coordinates to t-coordinates.
- *
- * First, the #focus converts our l such that we have
- * `l = (1 - k) * i / n + k * (i + 1) / n`.
+ * Interpolate between the two points of a polyline surrounding *l*, found by
+ * a binary search on their l-coordinates.
  *
- * Then, we get the approximate t by applying a similar relation:
- * `t = (1 - k) * anchors[i] + k * anchors[i + 1]`.
- *
- * \sa normalize_bezier
+ * See #oshu::bezier::distances.
  */
-static double l_to_t(oshu::bezier *bezier, double l)
+static oshu::point polyline_at(const oshu::point *points, const double *distances, int count, double l)
 {
-	int n = sizeof(bezier->anchors) / sizeof(*bezier->anchors) - 1;
-	int i = focus(&l, n);
-	return (1. - l) * bezier->anchors[i] + l * bezier->anchors[i + 1];
+	int low = 0, high = count - 1;
+	while (high - low > 1) {
+		int middle = (low + high) / 2;
+		if (distances[middle] <= l)
+			low = middle;
+		else
+			high = middle;
+	}
+	double span = distances[high] - distances[low];
+	double k = span > 0 ? (l - distances[low]) / span : 0;
+	return (1. - k) * points[low] + k * points[high];
 }
 
 /**
- * Every point on a Bézier line is an average of all the control points, so
- * it's safe to compute the bounding box of the polyline defined by them.
+ * Compute the bounding box of a polyline.
+ *
+ * For a sampled path, this is the box of the curve as it is drawn, much
+ * tighter than the box of its control points.
  */
-void bezier_bounding_box(oshu::bezier *bezier, oshu::point *top_left, oshu::point *bottom_right)
+static void polyline_bounding_box(const oshu::point *points, int count, oshu::point *top_left, oshu::point *bottom_right)
 {
-	assert (bezier->segment_count > 0);
-	*top_left = *bottom_right = bezier->control_points[0];
-	int count = bezier->indices[bezier->segment_count];
-	for (int i = 0; i < count; ++i)
-		extend_box(bezier->control_points[i], top_left, bottom_right);
+	*top_left = *bottom_right = points[0];
+	for (int i = 1; i < count; ++i)
+		extend_box(points[i], top_left, bottom_right);
 }
 
 /* Lines **********************************************************************/
@@ -317,7 +472,8 @@ void line_bounding_box(oshu::line *line, oshu::point *top_left, oshu::point *bot
 static oshu::point arc_at(oshu::arc *arc, double t)
 {
 	double angle = (1 - t) * arc->start_angle + t * arc->end_angle;
-	return arc->center + std::polar(arc->radius, angle);
+	oshu::vec2 offset = {(oshu::real) std::cos(angle), (oshu::real) std::sin(angle)};
+	return oshu::to_point(oshu::to_vec2(arc->center) + offset * (oshu::real) arc->radius);
 }
 
 /**
@@ -406,57 +562,240 @@ void arc_bounding_box(oshu::arc *arc, oshu::point *top_left, oshu::point *bottom
 	}
 }
 
+/* Catmull-Rom ****************************************************************/
+
+/**
+ * Compute the point at *t* on the *i*th segment of a Catmull-Rom spline, which
+ * goes from `control_points[i]` to `control_points[i+1]`.
+ *
+ * This is the formula of the official osu! client, including the way it
+ * mirrors the missing neighbours at both ends.
+ */
+static oshu::point catmull_segment_at(oshu::catmull *catmull, int i, double t)
+{
+	oshu::point *p = catmull->control_points;
+	int n = catmull->point_count;
+	oshu::point v1 = i > 0 ? p[i - 1] : p[i];
+	oshu::point v2 = p[i];
+	oshu::point v3 = i + 1 < n ? p[i + 1] : 2. * v2 - v1;
+	oshu::point v4 = i + 2 < n ? p[i + 2] : 2. * v3 - v2;
+	double t2 = t * t;
+	double t3 = t2 * t;
+	return .5 * (2. * v2
+	             + (-v1 + v3) * t
+	             + (2. * v1 - 5. * v2 + 4. * v3 - v4) * t2
+	             + (-v1 + 3. * v2 - 3. * v3 + v4) * t3);
+}
+
+/**
+ * Number of points per segment #normalize_catmull uses to measure a path.
+ */
+static const int catmull_detail = 16;
+
+/**
+ * Upper bound on the number of points #normalize_catmull uses to measure a
+ * path, which bounds the memory it uses on the stack.
+ */
+static const int max_catmull_points = 1024;
+
+/**
+ * Flatten the spline into #oshu::catmull::samples.
+ *
+ * The process is the same as #normalize_bezier's, with a simpler measure:
+ *
+ * 1. Pick `n + 1` points on the curve, evenly spaced in t-coordinates, with
+ *    #catmull_detail points per segment. Each segment gets the same share of
+ *    the [0, 1] range, like with #bezier_map, so that every control point is
+ *    one of them.
+ *
+ * 2. Compute their L-coordinates, that is their distance from the start along
+ *    the curve.
+ *
+ * 3. Keep the points before `target_length`, followed by the point at
+ *    `target_length`, interpolated between its two neighbours.
+ *
+ * When the path is too short, a point is added past the last one, which
+ * prolongs the path with a straight line.
+ */
+static void normalize_catmull(oshu::catmull *catmull, double target_length)
+{
+	assert (catmull->point_count >= 2);
+	assert (catmull->sample_capacity >= 3);
+	int n = (catmull->point_count - 1) * catmull_detail;
+	if (n > max_catmull_points || n < 1)
+		n = max_catmull_points;
+	if (n > catmull->sample_capacity - 2)
+		n = catmull->sample_capacity - 2;
+	oshu::point *p = catmull->samples;
+	double l[n + 1];
+
+	/* 1. and 2. */
+	double length = 0;
+	for (int i = 0; i <= n; ++i) {
+		double t = (double) i / n;
+		int segment = focus(&t, catmull->point_count - 1);
+		p[i] = catmull_segment_at(catmull, segment, t);
+		if (i > 0)
+			length += std::abs(p[i] - p[i - 1]);
+		l[i] = length;
+	}
+	if (length < epsilon) {
+		oshu_log_warning("degenerate catmull path");
+		catmull->sample_count = 2;
+		p[1] = p[0];
+		catmull->distances[0] = 0;
+		catmull->distances[1] = 1;
+		return;
+	}
+	if (length < target_length && length + 5. >= target_length)
+		/* ignore the rounding errors */
+		target_length = length;
+
+	/* 3. */
+	if (target_length > length) {
+		oshu::vector direction = p[n] - p[n - 1];
+		double span = std::abs(direction);
+		p[n + 1] = p[n] + (span < epsilon ? oshu::vector(0, 0) : direction / span * (target_length - length));
+		catmull->sample_count = n + 2;
+	} else {
+		int i = 1;
+		while (i < n && l[i] < target_length)
+			i++;
+		double span = l[i] - l[i - 1];
+		double k = span < epsilon ? 1. : (target_length - l[i - 1]) / span;
+		p[i] = (1. - k) * p[i - 1] + k * p[i];
+		catmull->sample_count = i + 1;
+	}
+	measure_polyline(catmull->samples, catmull->sample_count, catmull->distances);
+}
+
 /* Generic interface **********************************************************/
 
-void oshu::normalize_path(oshu::path *path, double length)
+/**
+ * Average distance between two points of a flattened Bézier path, in
+ * osu!pixels, from which #oshu::sample_capacity reserves room for its
+ * polyline.
+ *
+ * A 4-pixel chord is within .05 pixel of a circle whose radius is 40 pixels.
+ * On top of that, each segment gets room for twice the pieces the measure
+ * starts with. Tighter curves are flattened more coarsely if they don't fit.
+ */
+static const double sample_spacing = 4.;
+
+int oshu::sample_capacity(const oshu::path *path)
+{
+	if (path->type == oshu::BEZIER_PATH) {
+		/* the normalization may add a segment */
+		double count = 8 * (path->bezier.segment_count + 1) + 1;
+		if (path->length > 0)
+			count += path->length / sample_spacing;
+		return count < max_flat_points ? (int) count : max_flat_points;
+	} else if (path->type == oshu::CATMULL_PATH) {
+		int n = (path->catmull.point_count - 1) * catmull_detail;
+		if (n > max_catmull_points || n < 1)
+			n = max_catmull_points;
+		/* one more point to extend it */
+		return n + 2;
+	}
+	return 0;
+}
+
+static void normalize(oshu::path *path)
 {
 	switch (path->type) {
 	case oshu::LINEAR_PATH:
-		return normalize_line(&path->line, length);
+		return normalize_line(&path->line, path->length);
 	case oshu::PERFECT_PATH:
-		return normalize_arc(&path->arc, length);
+		return normalize_arc(&path->arc, path->length);
 	case oshu::BEZIER_PATH:
-		return normalize_bezier(&path->bezier, length);
+		return normalize_bezier(&path->bezier, path->length);
+	case oshu::CATMULL_PATH:
+		return normalize_catmull(&path->catmull, path->length);
 	default:
 		return;
 	}
 }
 
-oshu::point oshu::path_at(oshu::path *path, double t)
+/**
+ * The first thread to move the path from #oshu::RAW_PATH to
+ * #oshu::NORMALIZING_PATH does the work. The others spin until it's done,
+ * which is short as normalizing a single path takes a few microseconds.
+ */
+void oshu::normalize_path(oshu::path *path)
+{
+	int state = path->state.load(std::memory_order_acquire);
+	if (state == oshu::NORMALIZED_PATH)
+		return;
+	if (state == oshu::RAW_PATH && path->state.compare_exchange_strong(state, oshu::NORMALIZING_PATH, std::memory_order_acquire)) {
+		normalize(path);
+		path->state.store(oshu::NORMALIZED_PATH, std::memory_order_release);
+		return;
+	}
+	while (path->state.load(std::memory_order_acquire) != oshu::NORMALIZED_PATH)
+		std::this_thread::yield();
+}
+
+/**
+ * Map t from ℝ to [0,1], as explained in #oshu::path_at.
+ */
+static double fold(double t)
 {
-	/* map t from ℝ to [0,1] */
 	t = fabs(remainder(t, 2.));
 	assert (-epsilon <= t && t <= 1 + epsilon);
+	return t;
+}
+
+oshu::point oshu::path_at(oshu::path *path, double t)
+{
+	oshu::normalize_path(path);
+	t = fold(t);
 	switch (path->type) {
 	case oshu::LINEAR_PATH:
 		return line_at(&path->line, t);
 	case oshu::BEZIER_PATH:
-		t = l_to_t(&path->bezier, t);
-		return bezier_at(&path->bezier, t);
+		return polyline_at(path->bezier.samples, path->bezier.distances, path->bezier.sample_count, t);
 	case oshu::PERFECT_PATH:
 		return arc_at(&path->arc, t);
 	case oshu::CATMULL_PATH:
-		assert (path->type != oshu::CATMULL_PATH);
+		return polyline_at(path->catmull.samples, path->catmull.distances, path->catmull.sample_count, t);
 	default:
 		assert (path->type != path->type);
 	}
 	return 0;
 }
 
+int oshu::path_polyline(oshu::path *path, const oshu::point **points)
+{
+	oshu::normalize_path(path);
+	switch (path->type) {
+	case oshu::BEZIER_PATH:
+		*points = path->bezier.samples;
+		return path->bezier.sample_count;
+	case oshu::CATMULL_PATH:
+		*points = path->catmull.samples;
+		return path->catmull.sample_count;
+	default:
+		*points = NULL;
+		return 0;
+	}
+}
+
 void oshu::path_bounding_box(oshu::path *path, oshu::point *top_left, oshu::point *bottom_right)
 {
+	oshu::normalize_path(path);
 	switch (path->type) {
 	case oshu::LINEAR_PATH:
 		line_bounding_box(&path->line, top_left, bottom_right);
 		break;
 	case oshu::BEZIER_PATH:
-		bezier_bounding_box(&path->bezier, top_left, bottom_right);
+		polyline_bounding_box(path->bezier.samples, path->bezier.sample_count, top_left, bottom_right);
 		break;
 	case oshu::PERFECT_PATH:
 		arc_bounding_box(&path->arc, top_left, bottom_right);
 		break;
 	case oshu::CATMULL_PATH:
-		assert (path->type != oshu::CATMULL_PATH);
+		polyline_bounding_box(path->catmull.samples, path->catmull.sample_count, top_left, bottom_right);
+		break;
 	default:
 		assert (path->type != path->type);
 	}
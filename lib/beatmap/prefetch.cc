@@ -0,0 +1,69 @@
+/**
+ * \file beatmap/prefetch.cc
+ * \ingroup beatmap
+ *
+ * \brief
+ * Normalize the slider paths in the background.
+ */
+
+#include "beatmap/beatmap.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+struct oshu::path_prefetcher {
+	std::thread thread;
+	/**
+	 * Set by #oshu::cancel_path_prefetch to make the thread return before
+	 * reaching the end of the beatmap.
+	 */
+	std::atomic<bool> stop;
+	/**
+	 * Path of the beatmap file to cache once every path is normalized, or
+	 * empty.
+	 */
+	std::string path;
+};
+
+/**
+ * Walk the hit index, which is sorted by time, so that the first sliders to
+ * appear are the first normalized, then save the beatmap to the cache.
+ */
+static void prefetch(oshu::path_prefetcher *prefetcher, oshu::beatmap *beatmap)
+{
+	oshu::hit_index *index = &beatmap->hit_index;
+	for (int i = 0; i < index->size; ++i) {
+		if (prefetcher->stop.load(std::memory_order_relaxed))
+			return;
+		oshu::hit *hit = index->hits[i];
+		if (hit->type & oshu::SLIDER_HIT)
+			oshu::normalize_path(&hit->slider.path);
+	}
+	if (!prefetcher->path.empty() && !prefetcher->stop.load(std::memory_order_relaxed))
+		oshu::cache_beatmap(prefetcher->path.c_str(), beatmap);
+}
+
+void oshu::prefetch_paths(oshu::beatmap *beatmap, const char *path)
+{
+	if (beatmap->prefetcher)
+		return;
+	oshu::path_prefetcher *prefetcher = new oshu::path_prefetcher;
+	prefetcher->stop = false;
+	if (path)
+		prefetcher->path = path;
+	/* Set before the thread starts, as cache_beatmap copies the beatmap. */
+	beatmap->prefetcher = prefetcher;
+	prefetcher->thread = std::thread(prefetch, prefetcher, beatmap);
+}
+
+void oshu::cancel_path_prefetch(oshu::beatmap *beatmap)
+{
+	oshu::path_prefetcher *prefetcher = beatmap->prefetcher;
+	if (!prefetcher)
+		return;
+	prefetcher->stop = true;
+	prefetcher->thread.join();
+	delete prefetcher;
+	beatmap->prefetcher = nullptr;
+}
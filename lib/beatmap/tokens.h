@@ -8,9 +8,11 @@
  * This file is a bit magical as it uses a special `TOKEN` macro defined by the
  * file that includes *tokens.h*.
  *
- * It is an absolute requirement that the tokens are sorted in alphabetical order!
- * This lets us perform a dichotomic search when parsing, which makes lexing
- * orders of magnitude faster.
+ * The parser looks the tokens up with a perfect hash computed at compile time.
+ * If adding a token breaks the build with a collision, update the coefficients
+ * of *token_hash* in parser.cc.
+ *
+ * Please keep the list sorted in alphabetical order anyway.
  */
 
 TOKEN(ApproachRate)
@@ -0,0 +1,92 @@
+/**
+ * \file lib/core/arena.cc
+ * \ingroup core_arena
+ */
+
+#include "core/arena.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Size of the blocks the arena requests from the heap, header included.
+ *
+ * 64 KiB hold about 300 hit objects, which is the size of a short beatmap.
+ */
+static const size_t block_size = 64 * 1024;
+
+/**
+ * Every allocation is rounded up to a multiple of this, like *malloc* does.
+ */
+static const size_t alignment = alignof(max_align_t);
+
+static size_t align(size_t size)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Allocate a new block and make it the current one.
+ *
+ * The header is padded so that the first object of the block is aligned.
+ */
+static void grow(oshu::arena *arena, size_t size)
+{
+	size_t header = align(sizeof(oshu::arena_block));
+	size_t total = header + size;
+	if (total < block_size)
+		total = block_size;
+	oshu::arena_block *block = (oshu::arena_block*) calloc(1, total);
+	if (block == NULL)
+		abort();
+	if (arena->blocks)
+		arena->blocks->end = arena->cursor;
+	block->previous = arena->blocks;
+	arena->blocks = block;
+	arena->cursor = (char*) block + header;
+	arena->end = (char*) block + total;
+}
+
+void* oshu::arena_alloc(oshu::arena *arena, size_t size)
+{
+	size = align(size);
+	if (size == 0)
+		size = alignment;
+	if ((size_t) (arena->end - arena->cursor) < size)
+		grow(arena, size);
+	void *object = arena->cursor;
+	arena->cursor += size;
+	assert (arena->cursor <= arena->end);
+	return object;
+}
+
+void oshu::destroy_arena(oshu::arena *arena)
+{
+	oshu::arena_block *block = arena->blocks;
+	while (block != NULL) {
+		oshu::arena_block *previous = block->previous;
+		free(block);
+		block = previous;
+	}
+	arena->blocks = NULL;
+	arena->cursor = NULL;
+	arena->end = NULL;
+}
+
+void oshu::clear_arena(oshu::arena *arena)
+{
+	oshu::arena_block *block = arena->blocks;
+	if (block == NULL)
+		return;
+	oshu::arena_block *previous = block->previous;
+	while (previous != NULL) {
+		oshu::arena_block *next = previous->previous;
+		free(previous);
+		previous = next;
+	}
+	block->previous = NULL;
+	char *start = (char*) block + align(sizeof(oshu::arena_block));
+	memset(start, 0, arena->cursor - start);
+	arena->cursor = start;
+}
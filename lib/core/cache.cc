@@ -0,0 +1,33 @@
+/**
+ * \file lib/core/cache.cc
+ * \ingroup core_cache
+ */
+
+#include "core/cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+std::string oshu::cache_directory(const char *name)
+{
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	if (xdg && *xdg)
+		return std::string(xdg) + "/oshu/" + name;
+	const char *home = getenv("HOME");
+	if (home && *home)
+		return std::string(home) + "/.cache/oshu/" + name;
+	return "";
+}
+
+int oshu::make_directories(const std::string &directory)
+{
+	for (size_t i = 1; i <= directory.size(); ++i) {
+		if (i < directory.size() && directory[i] != '/')
+			continue;
+		std::string prefix = directory.substr(0, i);
+		if (mkdir(prefix.c_str(), 0755) < 0 && errno != EEXIST)
+			return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * \file lib/core/number.cc
+ * \ingroup core_number
+ */
+
+#include "core/number.h"
+
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Powers of ten that are exactly representable as doubles.
+ *
+ * Dividing an integer below 2^53 by one of them gives the correctly-rounded
+ * result, which is what *strtod* returns.
+ */
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const int max_scale = sizeof(powers_of_ten) / sizeof(*powers_of_ten) - 1;
+
+/**
+ * Any integer with that many digits is below 2^53.
+ */
+static const int max_digits = 15;
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+long oshu::read_integer(const char *str, char **end)
+{
+	const char *c = str;
+	while (is_space(*c))
+		++c;
+	bool negative = false;
+	if (*c == '-' || *c == '+')
+		negative = *c++ == '-';
+	const char *digits = c;
+	long value = 0;
+	while (is_digit(*c) && c - digits < 9)
+		value = value * 10 + (*c++ - '0');
+	if (is_digit(*c))
+		/* Might overflow, let the standard library clamp it. */
+		return strtol(str, end, 10);
+	if (c == digits) {
+		*end = (char*) str;
+		return 0;
+	}
+	*end = (char*) c;
+	return negative ? -value : value;
+}
+
+/**
+ * Parse the number with *strtod*, but in the C locale so that the decimal
+ * separator is always a dot.
+ */
+static double slow_read_decimal(const char *str, char **end)
+{
+	static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+	if (c_locale == (locale_t) 0)
+		return strtod(str, end);
+	return strtod_l(str, end, c_locale);
+}
+
+double oshu::read_decimal(const char *str, char **end)
+{
+	const char *c = str;
+	while (is_space(*c))
+		++c;
+	bool negative = false;
+	if (*c == '-' || *c == '+')
+		negative = *c++ == '-';
+	uint64_t mantissa = 0;
+	int significant_digits = 0;
+	int digits = 0;
+	int scale = 0;
+	for (; is_digit(*c); ++c, ++digits) {
+		mantissa = mantissa * 10 + (*c - '0');
+		if (mantissa)
+			++significant_digits;
+	}
+	if (*c == '.') {
+		for (++c; is_digit(*c); ++c, ++digits, ++scale) {
+			mantissa = mantissa * 10 + (*c - '0');
+			if (mantissa)
+				++significant_digits;
+		}
+	}
+	if (digits == 0 || significant_digits > max_digits || scale > max_scale)
+		return slow_read_decimal(str, end);
+	if (*c == 'e' || *c == 'E' || *c == 'x' || *c == 'X')
+		return slow_read_decimal(str, end);
+	*end = (char*) c;
+	double value = (double) mantissa / powers_of_ten[scale];
+	return negative ? -value : value;
+}
@@ -28,6 +28,7 @@ static int open_beatmap(const char *beatmap_path, oshu::game_base *game)
 	}
 	assert (game->beatmap.hits != NULL);
 	game->hit_cursor = game->beatmap.hits;
+	oshu::prefetch_paths(&game->beatmap, beatmap_path);
 	return 0;
 }
 
@@ -69,7 +70,7 @@ void game_base::rewind(double offset)
 
 	assert (this->hit_cursor != NULL);
 	while (this->hit_cursor->time > this->clock.now + 1.) {
-		this->hit_cursor->state = oshu::INITIAL_HIT;
+		oshu::set_hit_state(&this->beatmap, this->hit_cursor, oshu::INITIAL_HIT);
 		this->hit_cursor = this->hit_cursor->previous;
 	}
 }
@@ -84,7 +85,7 @@ void game_base::forward(double offset)
 
 	assert (this->hit_cursor != NULL);
 	while (this->hit_cursor->time < this->clock.now + 1.) {
-		this->hit_cursor->state = oshu::SKIPPED_HIT;
+		oshu::set_hit_state(&this->beatmap, this->hit_cursor, oshu::SKIPPED_HIT);
 		this->hit_cursor = this->hit_cursor->next;
 	}
 }
@@ -7,30 +7,16 @@
 
 oshu::hit* oshu::look_hit_back(oshu::game_base *game, double offset)
 {
-	oshu::hit *hit = game->hit_cursor;
-	double target = game->clock.now - offset;
-	/* seek backward */
-	while (oshu::hit_end_time(hit) > target)
-		hit = hit->previous;
-	/* seek forward */
-	while (oshu::hit_end_time(hit) < target)
-		hit = hit->next;
-	/* here we have the guarantee that hit->time >= target */
-	return hit;
+	oshu::hit_index *index = &game->beatmap.hit_index;
+	int i = oshu::find_active_hit(index, game->clock.now - offset);
+	return index->hits[i];
 }
 
 oshu::hit* oshu::look_hit_up(oshu::game_base *game, double offset)
 {
-	oshu::hit *hit = game->hit_cursor;
-	double target = game->clock.now + offset;
-	/* seek forward */
-	while (hit->time < target)
-		hit = hit->next;
-	/* seek backward */
-	while (hit->time > target)
-		hit = hit->previous;
-	/* here we have the guarantee that hit->time <= target */
-	return hit;
+	oshu::hit_index *index = &game->beatmap.hit_index;
+	int i = oshu::find_last_hit(index, game->clock.now + offset);
+	return index->hits[i];
 }
 
 oshu::hit* oshu::next_hit(oshu::game_base *game)
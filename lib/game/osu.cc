@@ -27,15 +27,16 @@ oshu::osu_game::osu_game(const char *beatmap_path)
  */
 static oshu::hit* find_hit(oshu::osu_game *game, oshu::point p)
 {
-	oshu::hit *start = oshu::look_hit_back(game, game->beatmap.difficulty.approach_time);
+	oshu::hit_index *index = &game->beatmap.hit_index;
+	int start = oshu::find_active_hit(index, game->clock.now - game->beatmap.difficulty.approach_time);
 	double max_time = game->clock.now + game->beatmap.difficulty.approach_time;
-	for (oshu::hit *hit = start; hit->time <= max_time; hit = hit->next) {
-		if (!(hit->type & (oshu::CIRCLE_HIT | oshu::SLIDER_HIT)))
+	for (int i = start; index->times[i] <= max_time; ++i) {
+		if (!(index->types[i] & (oshu::CIRCLE_HIT | oshu::SLIDER_HIT)))
 			continue;
-		if (hit->state != oshu::INITIAL_HIT)
+		if (index->states[i] != oshu::INITIAL_HIT)
 			continue;
-		if (std::abs(p - hit->p) <= game->beatmap.difficulty.circle_radius)
-			return hit;
+		if (std::abs(p - index->points[i]) <= game->beatmap.difficulty.circle_radius)
+			return index->hits[i];
 	}
 	return NULL;
 }
@@ -66,9 +67,9 @@ static void release_slider(oshu::osu_game *game)
 		return;
 	assert (hit->type & oshu::SLIDER_HIT);
 	if (game->clock.now < oshu::hit_end_time(hit) - game->beatmap.difficulty.leniency) {
-		hit->state = oshu::MISSED_HIT;
+		oshu::set_hit_state(&game->beatmap, hit, oshu::MISSED_HIT);
 	} else {
-		hit->state = oshu::GOOD_HIT;
+		oshu::set_hit_state(&game->beatmap, hit, oshu::GOOD_HIT);
 		oshu::play_sound(&game->library, &hit->slider.sounds[hit->slider.repeat], &game->audio);
 	}
 	jettison_hit(hit);
@@ -87,13 +88,15 @@ static void sonorize_slider(oshu::osu_game *game)
 	if (!hit)
 		return;
 	assert (hit->type & oshu::SLIDER_HIT);
-	int t = (game->clock.now - hit->time) / hit->slider.duration;
-	int prev_t = (game->clock.before - hit->time) / hit->slider.duration;
-	if (game->clock.now > oshu::hit_end_time(hit)) {
+	if (game->clock.now > hit->slider.end_time) {
 		release_slider(game);
-	} else if (t > prev_t && prev_t >= 0) {
-		assert (t <= hit->slider.repeat);
-		oshu::play_sound(&game->library, &hit->slider.sounds[t], &game->audio);
+		return;
+	}
+	int run = oshu::slider_run(hit, game->clock.now);
+	int prev_run = oshu::slider_run(hit, game->clock.before);
+	if (run > prev_run) {
+		assert (run < hit->slider.repeat);
+		oshu::play_sound(&game->library, &hit->slider.sounds[run], &game->audio);
 	}
 }
 
@@ -112,13 +115,12 @@ int oshu::osu_game::check()
 	sonorize_slider(this); /* < may release the slider! */
 	if (this->current_slider && mouse) {
 		oshu::hit *hit = this->current_slider;
-		double t = (this->clock.now - hit->time) / hit->slider.duration;
-		oshu::point ball = oshu::path_at(&hit->slider.path, t);
+		oshu::point ball = oshu::slider_ball(hit, this->clock.now);
 		oshu::point m = mouse->position();
 		if (std::abs(ball - m) > this->beatmap.difficulty.slider_tolerance) {
 			oshu::stop_loop(&this->audio);
 			this->current_slider = NULL;
-			hit->state = oshu::MISSED_HIT;
+			oshu::set_hit_state(&this->beatmap, hit, oshu::MISSED_HIT);
 			jettison_hit(hit);
 		}
 	}
@@ -127,9 +129,9 @@ int oshu::osu_game::check()
 	while (this->hit_cursor->time < left_wall) {
 		oshu::hit *hit = this->hit_cursor;
 		if (!(hit->type & (oshu::CIRCLE_HIT | oshu::SLIDER_HIT))) {
-			hit->state = oshu::UNKNOWN_HIT;
+			oshu::set_hit_state(&this->beatmap, hit, oshu::UNKNOWN_HIT);
 		} else if (hit->state == oshu::INITIAL_HIT) {
-			hit->state = oshu::MISSED_HIT;
+			oshu::set_hit_state(&this->beatmap, hit, oshu::MISSED_HIT);
 			jettison_hit(hit);
 		}
 		this->hit_cursor = hit->next;
@@ -150,16 +152,16 @@ static void activate_hit(oshu::osu_game *game, oshu::hit *hit, enum oshu::finger
 {
 	if (hit->type & oshu::SLIDER_HIT) {
 		release_slider(game);
-		hit->state = oshu::SLIDING_HIT;
+		oshu::set_hit_state(&game->beatmap, hit, oshu::SLIDING_HIT);
 		game->current_slider = hit;
 		game->held_key = key;
 		oshu::play_sound(&game->library, &hit->sound, &game->audio);
 		oshu::play_sound(&game->library, &hit->slider.sounds[0], &game->audio);
 	} else if (hit->type & oshu::CIRCLE_HIT) {
-		hit->state = oshu::GOOD_HIT;
+		oshu::set_hit_state(&game->beatmap, hit, oshu::GOOD_HIT);
 		oshu::play_sound(&game->library, &hit->sound, &game->audio);
 	} else {
-		hit->state = oshu::UNKNOWN_HIT;
+		oshu::set_hit_state(&game->beatmap, hit, oshu::UNKNOWN_HIT);
 	}
 }
 
@@ -193,7 +195,7 @@ int oshu::osu_game::press(enum oshu::finger key)
 		activate_hit(this, hit, key);
 		hit->offset = this->clock.now - hit->time;
 	} else {
-		hit->state = oshu::MISSED_HIT;
+		oshu::set_hit_state(&this->beatmap, hit, oshu::MISSED_HIT);
 		jettison_hit(hit);
 	}
 	return 0;
@@ -213,7 +215,7 @@ int oshu::osu_game::release(enum oshu::finger key)
 int oshu::osu_game::relinquish()
 {
 	if (this->current_slider) {
-		this->current_slider->state = oshu::INITIAL_HIT;
+		oshu::set_hit_state(&this->beatmap, this->current_slider, oshu::INITIAL_HIT);
 		oshu::stop_loop(&this->audio);
 		this->current_slider = NULL;
 	}
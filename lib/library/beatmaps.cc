@@ -11,6 +11,8 @@
 #include <algorithm>
 #include <dirent.h>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <sstream>
 #include <system_error>
 
@@ -20,15 +22,21 @@ beatmap_entry::beatmap_entry(const std::string &path)
 : path(path)
 {
 	oshu::beatmap beatmap;
-	int rc = oshu::load_beatmap_headers(path.c_str(), &beatmap);
+	int rc = oshu::scan_beatmap(path.c_str(), &beatmap);
 	if (rc < 0)
 		throw std::runtime_error("could not load beatmap " + path);
+	*this = beatmap_entry(path, beatmap);
+	oshu::destroy_beatmap(&beatmap);
+}
+
+beatmap_entry::beatmap_entry(const std::string &path, const oshu::beatmap &beatmap)
+: path(path)
+{
 	mode = beatmap.mode;
 	difficulty = beatmap.difficulty.overall_difficulty;
 	title = beatmap.metadata.title;
 	artist = beatmap.metadata.artist;
 	version = beatmap.metadata.version;
-	oshu::destroy_beatmap(&beatmap);
 }
 
 static bool osu_file(const char *filename)
@@ -39,8 +47,12 @@ static bool osu_file(const char *filename)
 	return !strcmp(filename + l - 4, ".osu");
 }
 
-static void find_entries(const std::string &path, beatmap_set &set)
+/**
+ * List the paths to the .osu files of a beatmap set directory.
+ */
+static std::vector<std::string> find_entries(const std::string &path)
 {
+	std::vector<std::string> paths;
 	DIR *dir = opendir(path.c_str());
 	if (!dir)
 		throw std::system_error(errno, std::system_category(), "could not open the beatmap set directory " + path);
@@ -48,6 +60,7 @@ static void find_entries(const std::string &path, beatmap_set &set)
 		errno = 0;
 		struct dirent* entry = readdir(dir);
 		if (errno) {
+			closedir(dir);
 			throw std::system_error(errno, std::system_category(), "could not read the beatmap set directory " + path);
 		} else if (!entry) {
 			// end of directory
@@ -58,21 +71,57 @@ static void find_entries(const std::string &path, beatmap_set &set)
 		} else if (!osu_file(entry->d_name)) {
 			continue;
 		} else {
-			try {
-				std::ostringstream os;
-				os << path << "/" << entry->d_name;
-				beatmap_entry entry (os.str());
-				if (entry.mode != oshu::OSU_MODE)
-					oshu::debug_log() << "skipping " << path << ": unsupported mode" << std::endl;
-				else
-					set.entries.push_back(std::move(entry));
-			} catch(std::runtime_error &e) {
-				oshu::warning_log() << e.what() << std::endl;
-				oshu::warning_log() << "ignoring invalid beatmap " << path << std::endl;
-			}
+			std::ostringstream os;
+			os << path << "/" << entry->d_name;
+			paths.push_back(os.str());
 		}
 	}
 	closedir(dir);
+	return paths;
+}
+
+/**
+ * Number of beatmaps scanned at once by #load_entries.
+ *
+ * Every beatmap of a batch stays in memory until the batch is over. Big
+ * libraries hold tens of thousands of beatmaps, so they're scanned in chunks
+ * to keep the memory bounded. A chunk is still large enough to keep all the
+ * processors busy.
+ */
+static const size_t scan_chunk_size = 256;
+
+/**
+ * Scan many beatmaps at once with #oshu::scan_beatmaps, which spreads the
+ * work across the processors.
+ *
+ * The invalid beatmaps are skipped with a warning, as are the beatmaps of
+ * unsupported modes. The result has an element for each path, which is null
+ * when the beatmap was skipped.
+ */
+static std::vector<std::unique_ptr<beatmap_entry>> load_entries(const std::vector<std::string> &paths)
+{
+	std::vector<const char*> c_paths;
+	for (const std::string &path : paths)
+		c_paths.push_back(path.c_str());
+	std::vector<std::unique_ptr<beatmap_entry>> entries(paths.size());
+	std::vector<oshu::beatmap> beatmaps(std::min(paths.size(), scan_chunk_size));
+	std::vector<int> status(beatmaps.size());
+	for (size_t chunk = 0; chunk < paths.size(); chunk += scan_chunk_size) {
+		size_t count = std::min(paths.size() - chunk, scan_chunk_size);
+		oshu::scan_beatmaps(&c_paths[chunk], count, beatmaps.data(), status.data());
+		for (size_t j = 0; j < count; ++j) {
+			size_t i = chunk + j;
+			if (status[j] < 0) {
+				oshu::warning_log() << "ignoring invalid beatmap " << paths[i] << std::endl;
+			} else if (beatmaps[j].mode != oshu::OSU_MODE) {
+				oshu::debug_log() << "skipping " << paths[i] << ": unsupported mode" << std::endl;
+			} else {
+				entries[i].reset(new beatmap_entry(paths[i], beatmaps[j]));
+			}
+			oshu::destroy_beatmap(&beatmaps[j]);
+		}
+	}
+	return entries;
 }
 
 static bool compare_entries(const beatmap_entry &a, const beatmap_entry &b)
@@ -93,7 +142,21 @@ static bool compare_sets(const beatmap_set &a, const beatmap_set &b)
 
 beatmap_set::beatmap_set(const std::string &path)
 {
-	find_entries(path, *this);
+	for (std::unique_ptr<beatmap_entry> &entry : load_entries(find_entries(path))) {
+		if (entry)
+			entries.push_back(std::move(*entry));
+	}
+	sort();
+}
+
+beatmap_set::beatmap_set(std::vector<beatmap_entry> &&entries)
+: entries(std::move(entries))
+{
+	sort();
+}
+
+void beatmap_set::sort()
+{
 	if (!empty()) {
 		title = entries[0].title;
 		artist = entries[0].artist;
@@ -110,6 +173,9 @@ std::vector<beatmap_set> find_beatmap_sets(const std::string &path)
 {
 	std::vector<beatmap_set> sets;
 
+	/* 1. List the .osu files of every set, without loading them. */
+	std::vector<std::string> paths;
+	std::vector<size_t> set_ends;
 	DIR *dir = opendir(path.c_str());
 	if (!dir)
 		throw std::system_error(errno, std::system_category(), "could not open the beatmaps directory " + path);
@@ -117,6 +183,7 @@ std::vector<beatmap_set> find_beatmap_sets(const std::string &path)
 		errno = 0;
 		struct dirent* entry = readdir(dir);
 		if (errno) {
+			closedir(dir);
 			throw std::system_error(errno, std::system_category(), "could not read the beatmaps directory");
 		} else if (!entry) {
 			// end of directory
@@ -128,15 +195,31 @@ std::vector<beatmap_set> find_beatmap_sets(const std::string &path)
 			try {
 				std::ostringstream os;
 				os << path << "/" << entry->d_name;
-				beatmap_set set (os.str());
-				if (!set.empty())
-					sets.push_back(std::move(set));
+				std::vector<std::string> set_paths = find_entries(os.str());
+				std::move(set_paths.begin(), set_paths.end(), std::back_inserter(paths));
+				set_ends.push_back(paths.size());
 			} catch (std::system_error& e) {
 				oshu::debug_log() << e.what() << std::endl;
 			}
 		}
 	}
 	closedir(dir);
+
+	/* 2. Load all the beatmaps of the library in one batch. */
+	std::vector<std::unique_ptr<beatmap_entry>> entries = load_entries(paths);
+
+	/* 3. Split them back into sets. */
+	size_t i = 0;
+	for (size_t end : set_ends) {
+		std::vector<beatmap_entry> set_entries;
+		for (; i < end; ++i) {
+			if (entries[i])
+				set_entries.push_back(std::move(*entries[i]));
+		}
+		beatmap_set set (std::move(set_entries));
+		if (!set.empty())
+			sets.push_back(std::move(set));
+	}
 	std::sort(sets.begin(), sets.end(), compare_sets);
 	return sets;
 }
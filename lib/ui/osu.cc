@@ -73,9 +73,8 @@ static void draw_slider(oshu::osu_ui &view, oshu::hit *hit)
 		oshu::draw_texture(view.display, hit->texture, hit->p);
 		draw_hint(view, hit);
 		/* ball */
-		double t = (now - hit->time) / hit->slider.duration;
 		if (hit->state == oshu::SLIDING_HIT) {
-			oshu::point ball = oshu::path_at(&hit->slider.path, t < 0 ? 0 : t);
+			oshu::point ball = oshu::slider_ball(hit, now);
 			oshu::draw_texture(display, &view.slider_ball, ball);
 		}
 	} else {
@@ -121,21 +120,22 @@ static void connect_hits(oshu::osu_ui &view, oshu::hit *a, oshu::hit *b)
 	oshu::game_base *game = &view.game;
 	if (a->state != oshu::INITIAL_HIT && a->state != oshu::SLIDING_HIT)
 		return;
-	oshu::point a_end = oshu::end_point(a);
-	double radius = game->beatmap.difficulty.circle_radius;
-	double interval = 15;
-	double center_distance = std::abs(b->p - a_end);
-	double edge_distance = center_distance - 2 * radius;
+	oshu::vec2 a_end = oshu::to_vec2(oshu::end_point(a));
+	oshu::vec2 b_start = oshu::to_vec2(b->p);
+	oshu::real radius = game->beatmap.difficulty.circle_radius;
+	oshu::real interval = 15;
+	oshu::real center_distance = oshu::length(b_start - a_end);
+	oshu::real edge_distance = center_distance - 2 * radius;
 	if (edge_distance < interval)
 		return;
 	int steps = edge_distance / interval;
 	assert (steps >= 1);
 	interval = edge_distance / steps; /* recalibrate */
-	oshu::vector direction = (b->p - a_end) / center_distance;
-	oshu::point start = a_end + direction * radius;
-	oshu::vector step = direction * interval;
+	oshu::vec2 direction = (b_start - a_end) / center_distance;
+	oshu::vec2 start = a_end + direction * radius;
+	oshu::vec2 step = direction * interval;
 	for (int i = 0; i < steps; ++i)
-		oshu::draw_texture(view.display, &view.connector, start + (i + .5) * step);
+		oshu::draw_texture(view.display, &view.connector, oshu::to_point(start + (i + (oshu::real) .5) * step));
 }
 
 namespace oshu {
@@ -167,14 +167,16 @@ osu_ui::~osu_ui()
 void osu_ui::draw()
 {
 	oshu::osu_view(display);
-	oshu::hit *cursor = oshu::look_hit_up(&game, game.beatmap.difficulty.approach_time);
-	oshu::hit *next = NULL;
+	oshu::hit_index *index = &game.beatmap.hit_index;
 	double now = game.clock.now;
-	for (oshu::hit *hit = cursor; hit; hit = hit->previous) {
-		if (!(hit->type & (oshu::CIRCLE_HIT | oshu::SLIDER_HIT)))
+	int cursor = oshu::find_last_hit(index, now + game.beatmap.difficulty.approach_time);
+	oshu::hit *next = NULL;
+	for (int i = cursor; i >= 0; --i) {
+		if (!(index->types[i] & (oshu::CIRCLE_HIT | oshu::SLIDER_HIT)))
 			continue;
-		if (oshu::hit_end_time(hit) < now - game.beatmap.difficulty.approach_time)
+		if (index->end_times[i] < now - game.beatmap.difficulty.approach_time)
 			break;
+		oshu::hit *hit = index->hits[i];
 		if (next && next->combo == hit->combo)
 			connect_hits(*this, hit, next);
 		draw_hit(*this, hit);
@@ -88,13 +88,12 @@ static void build_path(cairo_t *cr, oshu::slider *slider)
 		else
 			cairo_arc_negative(cr, std::real(arc->center), std::imag(arc->center), arc->radius, arc->start_angle, arc->end_angle);
 	} else {
-		oshu::point start = oshu::path_at(&slider->path, 0);
-		cairo_move_to(cr, std::real(start), std::imag(start));
-		int resolution = slider->length / 5. + 5;
-		for (int i = 1; i <= resolution; ++i) {
-			oshu::point pt = oshu::path_at(&slider->path, (double) i / resolution);
-			cairo_line_to(cr, std::real(pt), std::imag(pt));
-		}
+		const oshu::point *points;
+		int count = oshu::path_polyline(&slider->path, &points);
+		assert (count >= 2);
+		cairo_move_to(cr, std::real(points[0]), std::imag(points[0]));
+		for (int i = 1; i < count; ++i)
+			cairo_line_to(cr, std::real(points[i]), std::imag(points[i]));
 	}
 }
 
@@ -34,11 +34,11 @@ void oshu::destroy_texture(oshu::texture *texture)
 
 void oshu::draw_scaled_texture(oshu::display *display, oshu::texture *texture, oshu::point p, double ratio)
 {
-	oshu::point top_left = oshu::project(&display->view, p - texture->origin * ratio);
-	oshu::size size = texture->size * ratio * display->view.zoom;
+	oshu::vec2 top_left = oshu::project(&display->view, oshu::to_vec2(p) - oshu::to_vec2(texture->origin) * (oshu::real) ratio);
+	oshu::vec2 size = oshu::to_vec2(texture->size) * (oshu::real) (ratio * display->view.zoom);
 	SDL_Rect dest = {
-		.x = (int) std::real(top_left), .y = (int) std::imag(top_left),
-		.w = (int) std::real(size), .h = (int) std::imag(size),
+		.x = (int) top_left.x, .y = (int) top_left.y,
+		.w = (int) size.x, .h = (int) size.y,
 	};
 	SDL_RenderCopy(display->renderer, texture->texture, NULL, &dest);
 }
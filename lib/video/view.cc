@@ -40,6 +40,11 @@ oshu::point oshu::project(oshu::view *view, oshu::point p)
 	return p * view->zoom + view->origin;
 }
 
+oshu::vec2 oshu::project(oshu::view *view, oshu::vec2 p)
+{
+	return p * (oshu::real) view->zoom + oshu::to_vec2(view->origin);
+}
+
 oshu::point oshu::unproject(oshu::view *view, oshu::point p)
 {
 	return (p - view->origin) / view->zoom;
@@ -0,0 +1,93 @@
+#include "beatmap/beatmap.h"
+
+#include <cstring>
+
+#include <iostream>
+#include <vector>
+
+static const char *zerotokei = "Kaori Oda - Zero Tokei (Short ver.) (ShogunMoon) [Shining].osu";
+
+/**
+ * Load the same beatmap many more times than there are processors, so that
+ * every worker thread parses it concurrently with the other ones.
+ */
+static const int copies = 64;
+
+/**
+ * Compare a beatmap loaded by a worker thread with the reference one loaded
+ * alone, and return the number of differences.
+ */
+static int compare(oshu::beatmap *a, oshu::beatmap *b)
+{
+	if (std::strcmp(a->metadata.title, b->metadata.title) || std::strcmp(a->metadata.version, b->metadata.version)) {
+		std::cerr << "metadata differ" << std::endl;
+		return 1;
+	}
+	if (a->hit_index.size != b->hit_index.size) {
+		std::cerr << "hit counts differ: " << a->hit_index.size << ", " << b->hit_index.size << std::endl;
+		return 1;
+	}
+	int failures = 0;
+	for (int i = 0; i < a->hit_index.size; ++i) {
+		oshu::hit *x = a->hit_index.hits[i];
+		oshu::hit *y = b->hit_index.hits[i];
+		if (x->time != y->time || x->type != y->type || x->p != y->p || x->combo != y->combo) {
+			std::cerr << "hits differ at " << y->time << std::endl;
+			++failures;
+		}
+	}
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+	oshu::beatmap reference;
+	if (oshu::load_beatmap(zerotokei, &reference) < 0) {
+		std::cerr << "could not load " << zerotokei << std::endl;
+		return 1;
+	}
+
+	std::vector<const char*> paths(copies, zerotokei);
+	paths[copies / 2] = "missing.osu";
+	std::vector<oshu::beatmap> beatmaps(copies);
+	std::vector<int> status(copies);
+
+	int loaded = oshu::load_beatmaps(paths.data(), copies, beatmaps.data(), status.data());
+	if (loaded != copies - 1) {
+		std::cerr << "loaded " << loaded << " beatmaps, expected " << copies - 1 << std::endl;
+		++failures;
+	}
+	for (int i = 0; i < copies; ++i) {
+		if (i == copies / 2) {
+			if (status[i] == 0) {
+				std::cerr << "loaded a missing beatmap" << std::endl;
+				++failures;
+			}
+		} else if (status[i] < 0) {
+			std::cerr << "could not load beatmap " << i << std::endl;
+			++failures;
+		} else {
+			failures += compare(&beatmaps[i], &reference);
+		}
+		oshu::destroy_beatmap(&beatmaps[i]);
+	}
+
+	loaded = oshu::scan_beatmaps(paths.data(), copies, beatmaps.data(), status.data());
+	if (loaded != copies - 1) {
+		std::cerr << "scanned " << loaded << " beatmaps, expected " << copies - 1 << std::endl;
+		++failures;
+	}
+	for (int i = 0; i < copies; ++i) {
+		if (status[i] == 0 && std::strcmp(beatmaps[i].metadata.title, reference.metadata.title)) {
+			std::cerr << "unexpected title when scanning: " << beatmaps[i].metadata.title << std::endl;
+			++failures;
+		}
+		oshu::destroy_beatmap(&beatmaps[i]);
+	}
+
+	oshu::destroy_beatmap(&reference);
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
@@ -0,0 +1,126 @@
+#include "beatmap/beatmap.h"
+
+#include <cstring>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static const char *zerotokei = "Kaori Oda - Zero Tokei (Short ver.) (ShogunMoon) [Shining].osu";
+
+static const char *minimal =
+	"osu file format v14\n"
+	"\n"
+	"[General]\n"
+	"AudioFilename: audio.mp3\n"
+	"\n"
+	"[Metadata]\n"
+	"Title:Title\n"
+	"Artist:Artist\n"
+	"Version:Hard\n"
+	"\n"
+	"[TimingPoints]\n"
+	"0,500,4,2,1,50,1,0\n"
+	"\n"
+	"[HitObjects]\n"
+	"256,192,1000,1,0,0:0:0:0:\n"
+	"100,100,1500,2,0,B|200:100|200:200,1,150\n"
+	"300,300,3000,1,0,0:0:0:0:";
+
+static int count_hits(oshu::beatmap *beatmap)
+{
+	int count = 0;
+	for (oshu::hit *hit = beatmap->hits->next; hit && hit->next; hit = hit->next)
+		++count;
+	return count;
+}
+
+/**
+ * Compare a beatmap parsed from a buffer with the same beatmap loaded from its
+ * file, and return the number of differences.
+ */
+static int compare(oshu::beatmap *a, oshu::beatmap *b)
+{
+	int failures = 0;
+	if (std::strcmp(a->metadata.title, b->metadata.title)) {
+		std::cerr << "titles differ: " << a->metadata.title << ", " << b->metadata.title << std::endl;
+		++failures;
+	}
+	if (std::strcmp(a->audio_filename, b->audio_filename)) {
+		std::cerr << "audio files differ" << std::endl;
+		++failures;
+	}
+	if (count_hits(a) != count_hits(b)) {
+		std::cerr << "hit counts differ: " << count_hits(a) << ", " << count_hits(b) << std::endl;
+		return failures + 1;
+	}
+	oshu::hit *x = a->hits->next;
+	oshu::hit *y = b->hits->next;
+	for (; x->next && y->next; x = x->next, y = y->next) {
+		if (x->time != y->time || x->type != y->type || x->p != y->p) {
+			std::cerr << "hits differ at " << x->time << std::endl;
+			++failures;
+		} else if ((x->type & oshu::SLIDER_HIT) && oshu::path_at(&x->slider.path, 1) != oshu::path_at(&y->slider.path, 1)) {
+			std::cerr << "slider paths differ at " << x->time << std::endl;
+			++failures;
+		}
+	}
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+	oshu::beatmap a, b;
+
+	if (oshu::parse_beatmap(minimal, std::strlen(minimal), &a) < 0) {
+		std::cerr << "could not parse the minimal beatmap" << std::endl;
+		++failures;
+	} else {
+		if (std::strcmp(a.metadata.version, "Hard")) {
+			std::cerr << "unexpected version: " << a.metadata.version << std::endl;
+			++failures;
+		}
+		/* the last line has no line feed */
+		if (count_hits(&a) != 3) {
+			std::cerr << "expected 3 hits, got " << count_hits(&a) << std::endl;
+			++failures;
+		}
+		oshu::destroy_beatmap(&a);
+	}
+
+	const char *garbage = "this is not a beatmap\n";
+	if (oshu::parse_beatmap(garbage, std::strlen(garbage), &a) == 0) {
+		std::cerr << "parsed garbage as a beatmap" << std::endl;
+		oshu::destroy_beatmap(&a);
+		++failures;
+	}
+
+	std::ifstream file(zerotokei, std::ios::binary);
+	std::stringstream content;
+	content << file.rdbuf();
+	std::string data = content.str();
+	if (data.empty()) {
+		std::cerr << "could not read " << zerotokei << std::endl;
+		return failures + 1;
+	}
+	if (oshu::load_beatmap(zerotokei, &b) < 0) {
+		std::cerr << "could not load " << zerotokei << std::endl;
+		return failures + 1;
+	}
+	if (oshu::parse_beatmap(data.data(), data.size(), &a) < 0) {
+		std::cerr << "could not parse " << zerotokei << " from memory" << std::endl;
+		++failures;
+	} else {
+		/* the beatmap must not depend on the buffer once parsed */
+		data.assign(data.size(), '\0');
+		failures += compare(&a, &b);
+		oshu::destroy_beatmap(&a);
+	}
+	oshu::destroy_beatmap(&b);
+
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
@@ -0,0 +1,132 @@
+#include "beatmap/beatmap.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <ftw.h>
+#include <stdio.h>
+
+static const char *zerotokei = "Kaori Oda - Zero Tokei (Short ver.) (ShogunMoon) [Shining].osu";
+
+static int remove_file(const char *path, const struct stat*, int, struct FTW*)
+{
+	remove(path);
+	return 0;
+}
+
+/**
+ * Compare a beatmap loaded from its cache with the one that was saved, and
+ * return the number of differences.
+ */
+static int compare(oshu::beatmap *a, oshu::beatmap *b)
+{
+	int failures = 0;
+	if (std::strcmp(a->metadata.title, b->metadata.title) || std::strcmp(a->audio_filename, b->audio_filename)) {
+		std::cerr << "strings differ" << std::endl;
+		++failures;
+	}
+	if (a->difficulty.approach_time != b->difficulty.approach_time || a->color_count != b->color_count) {
+		std::cerr << "settings differ" << std::endl;
+		++failures;
+	}
+	if (a->hit_index.size != b->hit_index.size) {
+		std::cerr << "hit counts differ: " << a->hit_index.size << ", " << b->hit_index.size << std::endl;
+		return failures + 1;
+	}
+	for (int i = 0; i < a->hit_index.size; ++i) {
+		oshu::hit *x = a->hit_index.hits[i];
+		oshu::hit *y = b->hit_index.hits[i];
+		if (x->time != y->time || x->type != y->type || x->p != y->p || x->combo != y->combo) {
+			std::cerr << "hits differ at " << y->time << std::endl;
+			++failures;
+			continue;
+		}
+		if (!(x->type & oshu::SLIDER_HIT))
+			continue;
+		if (x->slider.path.state != oshu::NORMALIZED_PATH) {
+			std::cerr << "cached path not normalized at " << x->time << std::endl;
+			++failures;
+		}
+		for (double t = 0; t <= 1; t += .125) {
+			if (oshu::path_at(&x->slider.path, t) != oshu::path_at(&y->slider.path, t)) {
+				std::cerr << "slider paths differ at " << x->time << std::endl;
+				++failures;
+				break;
+			}
+		}
+		if (x->slider.end_time != y->slider.end_time || x->slider.tick_count != y->slider.tick_count) {
+			std::cerr << "slider timings differ at " << x->time << std::endl;
+			++failures;
+		}
+	}
+	return failures;
+}
+
+/**
+ * Work on a copy of the beatmap in a temporary directory, which is also the
+ * cache directory, so that nothing is written to the source tree.
+ */
+int main()
+{
+	int failures = 0;
+	const char *tmpdir = getenv("TMPDIR");
+	std::string directory = std::string(tmpdir ? tmpdir : "/tmp") + "/oshu_test_cache.XXXXXX";
+	if (!mkdtemp(&directory[0])) {
+		perror(directory.c_str());
+		return 1;
+	}
+	setenv("XDG_CACHE_HOME", directory.c_str(), 1);
+	std::string path = directory + "/beatmap.osu";
+	{
+		std::ifstream source(zerotokei, std::ios::binary);
+		std::ofstream copy(path, std::ios::binary);
+		copy << source.rdbuf();
+	}
+
+	oshu::beatmap parsed, cached;
+	if (oshu::load_beatmap(path.c_str(), &parsed) < 0) {
+		std::cerr << "could not load " << path << std::endl;
+		failures = 1;
+		goto cleanup;
+	}
+	oshu::cache_beatmap(path.c_str(), &parsed);
+
+	if (oshu::load_beatmap(path.c_str(), &cached) < 0) {
+		std::cerr << "could not load " << path << " again" << std::endl;
+		++failures;
+	} else {
+		if (cached.mapping) {
+			std::cerr << "the beatmap was not loaded from its cache" << std::endl;
+			++failures;
+		}
+		failures += compare(&cached, &parsed);
+		oshu::destroy_beatmap(&cached);
+	}
+
+	/* a modified beatmap must be parsed again */
+	{
+		std::ofstream copy(path, std::ios::binary | std::ios::app);
+		copy << "\n";
+	}
+	if (oshu::load_beatmap(path.c_str(), &cached) < 0) {
+		std::cerr << "could not load the modified " << path << std::endl;
+		++failures;
+	} else {
+		if (!cached.mapping) {
+			std::cerr << "a stale cache was loaded" << std::endl;
+			++failures;
+		}
+		oshu::destroy_beatmap(&cached);
+	}
+	oshu::destroy_beatmap(&parsed);
+
+cleanup:
+	nftw(directory.c_str(), remove_file, 8, FTW_DEPTH | FTW_PHYS);
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
@@ -0,0 +1,101 @@
+#include "beatmap/beatmap.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <iostream>
+
+/**
+ * The first slider is longer than its specified length and gets cut, the
+ * second is shorter and gets extended with a straight line.
+ */
+static const char *beatmap =
+	"osu file format v14\n"
+	"\n"
+	"[General]\n"
+	"AudioFilename: audio.mp3\n"
+	"\n"
+	"[Metadata]\n"
+	"Title:Catmull\n"
+	"Artist:Artist\n"
+	"Version:Normal\n"
+	"\n"
+	"[TimingPoints]\n"
+	"0,500,4,2,1,50,1,0\n"
+	"\n"
+	"[HitObjects]\n"
+	"100,100,1000,2,0,C|200:150|300:100,1,120\n"
+	"100,300,3000,2,0,C|200:350|300:300,1,400\n";
+
+/**
+ * Number of points sampled with #oshu::path_at to measure a path.
+ */
+static const int samples = 4096;
+
+/**
+ * Check the polyline, the length and the bounding box of the Catmull path of
+ * a slider, and return the number of failures.
+ */
+static int check_slider(oshu::hit *hit)
+{
+	int failures = 0;
+	oshu::path *path = &hit->slider.path;
+	if (path->type != oshu::CATMULL_PATH) {
+		std::cerr << "slider at " << hit->time << " is not a Catmull path" << std::endl;
+		return 1;
+	}
+	const oshu::point *points;
+	int count = oshu::path_polyline(path, &points);
+	if (count < 2 || points[0] != hit->p || oshu::path_at(path, 0) != hit->p) {
+		std::cerr << "slider at " << hit->time << " doesn't start at " << hit->p << std::endl;
+		++failures;
+	}
+	oshu::point top_left, bottom_right;
+	oshu::path_bounding_box(path, &top_left, &bottom_right);
+	double length = 0;
+	oshu::point previous = oshu::path_at(path, 0);
+	for (int i = 0; i <= samples; ++i) {
+		oshu::point p = oshu::path_at(path, (double) i / samples);
+		length += std::abs(p - previous);
+		previous = p;
+		if (std::real(p) < std::real(top_left) - 1e-6 || std::real(p) > std::real(bottom_right) + 1e-6
+		    || std::imag(p) < std::imag(top_left) - 1e-6 || std::imag(p) > std::imag(bottom_right) + 1e-6) {
+			std::cerr << "slider at " << hit->time << ": " << p << " lies outside of its bounding box "
+			          << top_left << ", " << bottom_right << std::endl;
+			++failures;
+			break;
+		}
+	}
+	if (std::fabs(length - hit->slider.length) > .5) {
+		std::cerr << "slider at " << hit->time << " is " << length << " long, expected "
+		          << hit->slider.length << std::endl;
+		++failures;
+	}
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+	oshu::beatmap b;
+	if (oshu::parse_beatmap(beatmap, std::strlen(beatmap), &b) < 0) {
+		std::cerr << "could not parse the beatmap" << std::endl;
+		return 1;
+	}
+	int sliders = 0;
+	for (oshu::hit *hit = b.hits->next; hit && hit->next; hit = hit->next) {
+		if (!(hit->type & oshu::SLIDER_HIT))
+			continue;
+		++sliders;
+		failures += check_slider(hit);
+	}
+	if (sliders != 2) {
+		std::cerr << "expected 2 sliders, got " << sliders << std::endl;
+		++failures;
+	}
+	oshu::destroy_beatmap(&b);
+
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
@@ -0,0 +1,100 @@
+#include "core/number.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+#include <random>
+#include <string>
+
+static const char *integers[] = {
+	"0", "-0", "+0", "7", "-12", "+34", "  56", "\t-78", "123456789",
+	"1234567890", "-2147483648", "2147483648", "9223372036854775807",
+	"9223372036854775808", "-9223372036854775809", "12345678901234567890123",
+	"00000000000000000000042", "12abc", "-", "+", "", "  ", "abc", "--1",
+	"1.5", "1e3", "0x10", " +-3",
+};
+
+static const char *decimals[] = {
+	"0", "-0", "+0", "0.0", "-0.0", "1", "-1", "0.5", "-.5", "5.", ".",
+	"  1.25", "\t-3.75", "0.1", "0.2", "0.3", "1.1", "123.456",
+	"1e3", "1E-3", "-2.5e+2", "1e", "1e+", "1.5e400", "1e-400",
+	"123456789012345", "1234567890123456", "12345678901234567890",
+	"123456789012345678901234567890", "0.000000000000000000001",
+	"0.0000000000000000000000001", "1.0000000000000000000001",
+	"9007199254740993", "0.30000000000000004", "179769313486231570000000000000000000000",
+	"0x1p3", "inf", "-infinity", "nan", "abc", "", "-", "+.", "1..2",
+	"00000000000000000000000.5", "3.14159265358979323846264338327950288",
+};
+
+static int check_integer(const char *str)
+{
+	char *end, *expected_end;
+	long value = oshu::read_integer(str, &end);
+	long expected = std::strtol(str, &expected_end, 10);
+	if (value != expected || end != expected_end) {
+		std::cerr << "read_integer(\"" << str << "\") = " << value << " ending at " << end - str
+		          << ", expected " << expected << " ending at " << expected_end - str << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * The doubles are compared bit by bit, to tell -0 from 0 and to compare NaNs.
+ */
+static int check_decimal(const char *str)
+{
+	char *end, *expected_end;
+	double value = oshu::read_decimal(str, &end);
+	double expected = std::strtod(str, &expected_end);
+	if (std::memcmp(&value, &expected, sizeof(value)) || end != expected_end) {
+		std::cerr.precision(17);
+		std::cerr << "read_decimal(\"" << str << "\") = " << value << " ending at " << end - str
+		          << ", expected " << expected << " ending at " << expected_end - str << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Generate a number like the ones found in beatmaps, with up to 22 digits
+ * and sometimes an exponent, to cover the fast path and its limits.
+ */
+static std::string random_number(std::mt19937 &rng)
+{
+	std::uniform_int_distribution<int> digit('0', '9');
+	std::uniform_int_distribution<int> length(0, 22);
+	std::uniform_int_distribution<int> choice(0, 9);
+	std::string number;
+	if (choice(rng) < 3)
+		number += choice(rng) < 5 ? '-' : '+';
+	for (int n = length(rng); n > 0; --n)
+		number += digit(rng);
+	if (choice(rng) < 7) {
+		number += '.';
+		for (int n = length(rng); n > 0; --n)
+			number += digit(rng);
+	}
+	if (choice(rng) == 0)
+		number += "e" + std::to_string(choice(rng) * 10 - 40);
+	return number;
+}
+
+int main()
+{
+	int failures = 0;
+	for (const char *str : integers)
+		failures += check_integer(str);
+	for (const char *str : decimals)
+		failures += check_decimal(str);
+	std::mt19937 rng(42);
+	for (int i = 0; i < 100000; ++i) {
+		std::string number = random_number(rng);
+		failures += check_integer(number.c_str());
+		failures += check_decimal(number.c_str());
+	}
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
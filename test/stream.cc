@@ -0,0 +1,136 @@
+#include "beatmap/beatmap.h"
+
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static const char *zerotokei = "Kaori Oda - Zero Tokei (Short ver.) (ShogunMoon) [Shining].osu";
+
+/**
+ * Count what the parser reports, and check the hits arrive in order.
+ */
+struct counter : public oshu::beatmap_listener {
+	int sections = 0;
+	int timing_points = 0;
+	int hits = 0;
+	double last_time = -1;
+	bool ordered = true;
+	void section(oshu::beatmap&, const char*) override { ++sections; }
+	void timing_point(oshu::beatmap&, oshu::timing_point*) override { ++timing_points; }
+	void hit(oshu::beatmap&, oshu::hit *hit) override
+	{
+		if (hit->time < last_time)
+			ordered = false;
+		last_time = hit->time;
+		++hits;
+	}
+};
+
+/**
+ * Feed the whole input to a stream, *chunk* bytes at a time.
+ */
+static int feed(const std::string &data, size_t chunk, oshu::beatmap *beatmap, oshu::beatmap_listener *listener)
+{
+	oshu::beatmap_stream *stream = oshu::open_beatmap_stream(beatmap, listener);
+	int rc = 0;
+	for (size_t i = 0; i < data.size() && rc == 0; i += chunk)
+		rc = oshu::feed_beatmap_stream(stream, data.data() + i, std::min(chunk, data.size() - i));
+	if (oshu::close_beatmap_stream(stream) < 0)
+		rc = -1;
+	return rc;
+}
+
+/**
+ * Compare a beatmap parsed from a stream with the one parsed at once, and
+ * return the number of differences.
+ */
+static int compare(oshu::beatmap *a, oshu::beatmap *b)
+{
+	int failures = 0;
+	if (std::strcmp(a->metadata.title, b->metadata.title) || std::strcmp(a->metadata.version, b->metadata.version)) {
+		std::cerr << "metadata differ" << std::endl;
+		++failures;
+	}
+	if (a->hit_index.size != b->hit_index.size) {
+		std::cerr << "hit counts differ: " << a->hit_index.size << ", " << b->hit_index.size << std::endl;
+		return failures + 1;
+	}
+	for (int i = 0; i < a->hit_index.size; ++i) {
+		oshu::hit *x = a->hit_index.hits[i];
+		oshu::hit *y = b->hit_index.hits[i];
+		if (x->time != y->time || x->type != y->type || x->p != y->p || x->combo != y->combo) {
+			std::cerr << "hits differ at " << y->time << std::endl;
+			++failures;
+		} else if ((x->type & oshu::SLIDER_HIT) && oshu::path_at(&x->slider.path, 1) != oshu::path_at(&y->slider.path, 1)) {
+			std::cerr << "slider paths differ at " << y->time << std::endl;
+			++failures;
+		}
+	}
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+	std::ifstream file(zerotokei, std::ios::binary);
+	std::stringstream content;
+	content << file.rdbuf();
+	std::string data = content.str();
+	oshu::beatmap reference;
+	if (data.empty() || oshu::parse_beatmap(data.data(), data.size(), &reference) < 0) {
+		std::cerr << "could not parse " << zerotokei << std::endl;
+		return 1;
+	}
+
+	for (size_t chunk : {1, 2, 3, 7, 64, 4096}) {
+		oshu::beatmap beatmap;
+		counter listener;
+		if (feed(data, chunk, &beatmap, &listener) < 0) {
+			std::cerr << "could not parse the stream in chunks of " << chunk << " bytes" << std::endl;
+			++failures;
+			continue;
+		}
+		failures += compare(&beatmap, &reference);
+		/* not counting the two unreachable hits */
+		if (listener.hits != reference.hit_index.size - 2 || !listener.ordered) {
+			std::cerr << "the listener saw " << listener.hits << " hits in chunks of " << chunk << " bytes" << std::endl;
+			++failures;
+		}
+		if (listener.sections == 0 || listener.timing_points == 0) {
+			std::cerr << "the listener missed the sections or the timing points" << std::endl;
+			++failures;
+		}
+		oshu::destroy_beatmap(&beatmap);
+	}
+
+	/* discarding the hits as they come */
+	oshu::beatmap beatmap;
+	counter listener;
+	listener.keep_hits = false;
+	if (feed(data, 1, &beatmap, &listener) < 0) {
+		std::cerr << "could not parse the stream without keeping the hits" << std::endl;
+		++failures;
+	} else {
+		if (listener.hits != reference.hit_index.size - 2 || beatmap.hit_index.size != 2) {
+			std::cerr << "unexpected hits when discarding them" << std::endl;
+			++failures;
+		}
+		oshu::destroy_beatmap(&beatmap);
+	}
+
+	const char *garbage = "this is not a beatmap\n";
+	if (feed(garbage, 1, &beatmap, nullptr) == 0) {
+		std::cerr << "parsed garbage as a beatmap" << std::endl;
+		oshu::destroy_beatmap(&beatmap);
+		++failures;
+	}
+
+	oshu::destroy_beatmap(&reference);
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
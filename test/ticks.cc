@@ -0,0 +1,105 @@
+#include "beatmap/beatmap.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <iostream>
+
+/**
+ * The inherited timing point doubles the slider velocity, so the slider lasts
+ * .38 second per run, but the ticks keep the base beat duration: one every
+ * .5 / 4 = .125 second. The third tick of a run would be 5 ms away from its
+ * end, within the margin, and is dropped.
+ */
+static const char *beatmap =
+	"osu file format v14\n"
+	"\n"
+	"[General]\n"
+	"AudioFilename: audio.mp3\n"
+	"\n"
+	"[Metadata]\n"
+	"Title:Ticks\n"
+	"Artist:Artist\n"
+	"Version:Normal\n"
+	"\n"
+	"[Difficulty]\n"
+	"SliderMultiplier:1\n"
+	"SliderTickRate:4\n"
+	"\n"
+	"[TimingPoints]\n"
+	"0,500,4,2,1,50,1,0\n"
+	"1000,-50,4,2,1,50,0,0\n"
+	"\n"
+	"[HitObjects]\n"
+	"100,100,2000,2,0,L|252:100,2,152\n";
+
+static const double edges[] = {2., 2.38, 2.76};
+
+/**
+ * The second run goes backwards, so its ticks are mirrored to stay at 1/3 and
+ * 2/3 of the path.
+ */
+static const double ticks[] = {2.125, 2.25, 2.51, 2.635};
+
+static int check_time(const char *name, double value, double expected)
+{
+	if (std::fabs(value - expected) > 1e-9) {
+		std::cerr << name << " is " << value << ", expected " << expected << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int check_run(oshu::hit *hit, double time, int expected)
+{
+	int run = oshu::slider_run(hit, time);
+	if (run != expected) {
+		std::cerr << "slider run at " << time << " is " << run << ", expected " << expected << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	int failures = 0;
+	oshu::beatmap b;
+	if (oshu::parse_beatmap(beatmap, std::strlen(beatmap), &b) < 0) {
+		std::cerr << "could not parse the beatmap" << std::endl;
+		return 1;
+	}
+	oshu::hit *hit = b.hits->next;
+	if (!(hit->type & oshu::SLIDER_HIT) || hit->slider.repeat != 2) {
+		std::cerr << "expected a slider with 2 runs" << std::endl;
+		oshu::destroy_beatmap(&b);
+		return 1;
+	}
+	oshu::slider *slider = &hit->slider;
+
+	failures += check_time("duration", slider->duration, .38);
+	failures += check_time("end time", slider->end_time, edges[2]);
+	for (int i = 0; i <= slider->repeat; ++i)
+		failures += check_time("edge", slider->edges[i], edges[i]);
+
+	if (slider->tick_count != 4) {
+		std::cerr << "expected 4 ticks, got " << slider->tick_count << std::endl;
+		++failures;
+	} else {
+		for (int i = 0; i < slider->tick_count; ++i)
+			failures += check_time("tick", slider->ticks[i], ticks[i]);
+	}
+
+	/* the runs change exactly at the edges, and clamp outside the slider */
+	failures += check_run(hit, 1., 0);
+	failures += check_run(hit, slider->edges[0], 0);
+	failures += check_run(hit, 2.3, 0);
+	failures += check_run(hit, slider->edges[1], 1);
+	failures += check_run(hit, slider->edges[2], 1);
+	failures += check_run(hit, 3., 1);
+
+	oshu::destroy_beatmap(&b);
+
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}